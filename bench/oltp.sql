@@ -0,0 +1,10 @@
+-- Concurrent OLTP workload for bench/run.sh: a point read, an update and an
+-- insert per transaction on the table being expired.
+\set id random(1, :rows)
+\set account random(0, 1000)
+BEGIN;
+SELECT payload FROM bench_events WHERE id = :id;
+UPDATE bench_events SET payload = md5(payload) WHERE id = :id;
+INSERT INTO bench_events (account_id, created_at, payload)
+VALUES (:account, now(), md5(random()::TEXT));
+END;
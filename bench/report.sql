@@ -0,0 +1,8 @@
+-- Table state after the expiry pass, for bench/run.sh.
+SELECT pg_size_pretty(pg_table_size('bench_events')) AS heap_size,
+       pg_size_pretty(pg_indexes_size('bench_events')) AS index_size,
+       s.n_live_tup AS live_rows,
+       s.n_dead_tup AS dead_rows,
+       round(100.0 * s.n_dead_tup / NULLIF(s.n_live_tup + s.n_dead_tup, 0), 1) AS dead_pct
+FROM pg_stat_user_tables s
+WHERE s.relid = 'bench_events'::REGCLASS;
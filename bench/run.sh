@@ -0,0 +1,198 @@
+#!/bin/bash
+#
+# TTL throughput benchmark for pg_ttl_index
+#
+# Loads bench_events at the configured scale, measures a baseline OLTP
+# pgbench workload, then expires the table with ttl_runner() while the same
+# workload runs again, and reports:
+#
+#   - rows expired per second
+#   - WAL bytes per expired row (net of the baseline workload's WAL rate)
+#   - p99 latency of the OLTP workload, baseline and during expiry
+#   - table and index size and dead tuples after the run
+#
+# The target cluster is taken from the usual PGHOST/PGPORT/PGUSER variables
+# and must have pg_ttl_index installed and preloaded. Settings come from the
+# environment, so two strategies or two builds can be compared by changing
+# one variable:
+#
+#   BENCH_DB           database to (re)create          (pg_ttl_bench)
+#   BENCH_ROWS         rows loaded                     (1000000)
+#   BENCH_EXPIRED_PCT  percentage already expired      (50)
+#   BENCH_TTL          rule TTL in seconds             (86400)
+#   BENCH_DIST         clustered | scattered           (clustered)
+#   BENCH_STRATEGY     hard | soft | archive_table     (hard)
+#   BENCH_BATCH_SIZE   rule batch size                 (10000)
+#   BENCH_CLIENTS      pgbench clients                 (8)
+#   BENCH_DURATION     seconds per pgbench phase       (30)
+#   BENCH_SEED         random seed                     (42)
+#
+
+set -euo pipefail
+
+BENCH_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+
+BENCH_DB="${BENCH_DB:-pg_ttl_bench}"
+BENCH_ROWS="${BENCH_ROWS:-1000000}"
+BENCH_EXPIRED_PCT="${BENCH_EXPIRED_PCT:-50}"
+BENCH_TTL="${BENCH_TTL:-86400}"
+BENCH_DIST="${BENCH_DIST:-clustered}"
+BENCH_STRATEGY="${BENCH_STRATEGY:-hard}"
+BENCH_BATCH_SIZE="${BENCH_BATCH_SIZE:-10000}"
+BENCH_CLIENTS="${BENCH_CLIENTS:-8}"
+BENCH_DURATION="${BENCH_DURATION:-30}"
+BENCH_SEED="${BENCH_SEED:-42}"
+
+# Colors for output
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m' # No Color
+
+info() {
+    echo -e "${GREEN}[INFO]${NC} $1" >&2
+}
+
+error() {
+    echo -e "${RED}[ERROR]${NC} $1" >&2
+}
+
+sql() {
+    psql -X -q -At -v ON_ERROR_STOP=1 -d "$BENCH_DB" -c "$1"
+}
+
+now() {
+    date +%s.%N
+}
+
+# p99 of the per-transaction latencies (microseconds, third column) in the
+# pgbench logs under $1, printed in milliseconds
+p99_ms() {
+    cat "$1"/pgbench_log.* | awk '{ print $3 }' | sort -n |
+        awk '{ v[NR] = $1 } END { if (NR == 0) { print "n/a"; exit }
+                                   i = int(NR * 0.99); if (i < 1) i = 1
+                                   printf "%.2f\n", v[i] / 1000 }'
+}
+
+# Runs the OLTP workload for BENCH_DURATION seconds, logging every
+# transaction under $1
+run_pgbench() {
+    mkdir -p "$1"
+    (cd "$1" && pgbench -n -c "$BENCH_CLIENTS" -j "$BENCH_CLIENTS" -T "$BENCH_DURATION" \
+        --random-seed="$BENCH_SEED" -D rows="$BENCH_ROWS" -l \
+        -f "$BENCH_DIR/oltp.sql" "$BENCH_DB" > pgbench.out 2>&1)
+}
+
+check_prerequisites() {
+    for cmd in psql pgbench createdb dropdb; do
+        if ! command -v "$cmd" &> /dev/null; then
+            error "$cmd not found. Put the PostgreSQL client binaries on PATH."
+            exit 1
+        fi
+    done
+
+    case "$BENCH_STRATEGY" in
+        hard|soft|archive_table) ;;
+        *) error "BENCH_STRATEGY must be hard, soft or archive_table"; exit 1 ;;
+    esac
+
+    case "$BENCH_DIST" in
+        clustered|scattered) ;;
+        *) error "BENCH_DIST must be clustered or scattered"; exit 1 ;;
+    esac
+}
+
+setup_database() {
+    info "Creating $BENCH_DB with $BENCH_ROWS rows ($BENCH_EXPIRED_PCT% expired, $BENCH_DIST)..."
+
+    dropdb --if-exists "$BENCH_DB"
+    createdb "$BENCH_DB"
+    sql "CREATE EXTENSION pg_ttl_index"
+
+    psql -X -q -v ON_ERROR_STOP=1 -d "$BENCH_DB" \
+        -v rows="$BENCH_ROWS" -v expired_pct="$BENCH_EXPIRED_PCT" -v ttl="$BENCH_TTL" \
+        -v dist="$BENCH_DIST" -v seed="$(awk -v s="$BENCH_SEED" 'BEGIN { print (s % 1000) / 1000 }')" \
+        -f "$BENCH_DIR/setup.sql" > /dev/null
+
+    # The benchmark drives the runner itself; a worker would race it.
+    sql "SELECT ttl_stop_worker()" > /dev/null || true
+
+    case "$BENCH_STRATEGY" in
+        hard)
+            sql "SELECT ttl_create_index('bench_events', 'created_at', $BENCH_TTL,
+                                         p_batch_size => $BENCH_BATCH_SIZE)" > /dev/null ;;
+        soft)
+            sql "SELECT ttl_create_index('bench_events', 'created_at', $BENCH_TTL,
+                                         p_batch_size => $BENCH_BATCH_SIZE,
+                                         p_soft_delete_column => 'deleted_at')" > /dev/null ;;
+        archive_table)
+            sql "SELECT ttl_create_index('bench_events', 'created_at', $BENCH_TTL,
+                                         p_batch_size => $BENCH_BATCH_SIZE,
+                                         p_archive_table => 'bench_archive')" > /dev/null ;;
+    esac
+
+    sql "CHECKPOINT"
+}
+
+main() {
+    local workdir baseline_wal baseline_start baseline_end baseline_rate
+    local wal_start wal_end expire_start expire_end expired rows pgbench_pid
+    local elapsed wal_net
+
+    check_prerequisites
+    setup_database
+
+    workdir="$(mktemp -d)"
+    trap 'rm -rf "$workdir"' EXIT
+
+    info "Baseline: OLTP workload alone for $BENCH_DURATION s..."
+    baseline_wal="$(sql "SELECT pg_current_wal_lsn()")"
+    baseline_start="$(now)"
+    run_pgbench "$workdir/baseline"
+    baseline_end="$(now)"
+    baseline_rate="$(sql "SELECT pg_wal_lsn_diff(pg_current_wal_lsn(), '$baseline_wal')
+                                 / ($baseline_end - $baseline_start)")"
+
+    info "Expiry: ttl_runner() until the table is caught up, with the OLTP workload running..."
+    run_pgbench "$workdir/expiry" &
+    pgbench_pid=$!
+
+    wal_start="$(sql "SELECT pg_current_wal_lsn()")"
+    expire_start="$(now)"
+    expired=0
+    while :; do
+        rows="$(sql "SELECT ttl_runner()")"
+        expired=$((expired + rows))
+        [ "$rows" -eq 0 ] && break
+    done
+    expire_end="$(now)"
+    wal_end="$(sql "SELECT pg_current_wal_lsn()")"
+
+    wait "$pgbench_pid"
+
+    elapsed="$(awk -v a="$expire_start" -v b="$expire_end" 'BEGIN { printf "%.3f", b - a }')"
+    wal_net="$(sql "SELECT GREATEST(pg_wal_lsn_diff('$wal_end', '$wal_start')
+                                    - $baseline_rate * $elapsed, 0)::BIGINT")"
+
+    sleep 1 # let the cumulative statistics catch up
+
+    echo ""
+    echo "pg_ttl_index benchmark: strategy=$BENCH_STRATEGY dist=$BENCH_DIST rows=$BENCH_ROWS" \
+         "expired_pct=$BENCH_EXPIRED_PCT batch_size=$BENCH_BATCH_SIZE clients=$BENCH_CLIENTS"
+    echo ""
+    echo "rows expired:            $expired"
+    echo "expiry time (s):         $elapsed"
+    awk -v n="$expired" -v t="$elapsed" \
+        'BEGIN { printf "rows/sec:                %.0f\n", (t > 0 ? n / t : 0) }'
+    awk -v w="$wal_net" -v n="$expired" \
+        'BEGIN { if (n > 0) printf "WAL bytes per row:       %.1f\n", w / n
+                 else print "WAL bytes per row:       n/a" }'
+    echo "OLTP p99 baseline (ms):  $(p99_ms "$workdir/baseline")"
+    echo "OLTP p99 expiry (ms):    $(p99_ms "$workdir/expiry")"
+    if awk -v t="$elapsed" -v d="$BENCH_DURATION" 'BEGIN { exit !(t > d) }'; then
+        echo "                         (expiry outlasted the workload; raise BENCH_DURATION)"
+    fi
+    echo ""
+    psql -X -d "$BENCH_DB" -f "$BENCH_DIR/report.sql"
+}
+
+main
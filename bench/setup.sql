@@ -0,0 +1,42 @@
+--
+-- Benchmark data set for bench/run.sh
+--
+-- psql variables:
+--   rows         number of rows to load
+--   expired_pct  percentage of rows already past their TTL
+--   ttl          rule TTL in seconds
+--   dist         physical order: 'clustered' (insert order follows created_at)
+--                or 'scattered' (expired rows spread over the whole heap)
+--   seed         random seed, so runs are reproducible
+--
+
+SET client_min_messages = warning;
+
+DROP TABLE IF EXISTS bench_archive;
+DROP TABLE IF EXISTS bench_events;
+
+CREATE TABLE bench_events (
+    id BIGSERIAL PRIMARY KEY,
+    account_id INTEGER NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL,
+    deleted_at TIMESTAMPTZ,
+    payload TEXT NOT NULL
+);
+
+SELECT setseed(:seed);
+
+INSERT INTO bench_events (account_id, created_at, payload)
+SELECT account_id, created_at, payload
+FROM (
+    SELECT (random() * 1000)::INTEGER AS account_id,
+           now() - make_interval(secs => CASE WHEN random() * 100 < :expired_pct
+                                              THEN :ttl * (1 + random())
+                                              ELSE :ttl * 0.9 * random() END) AS created_at,
+           md5(g::TEXT) || md5((g + 1)::TEXT) AS payload
+    FROM generate_series(1, :rows) AS g
+) s
+ORDER BY CASE WHEN :'dist' = 'clustered' THEN extract(EPOCH FROM created_at) ELSE random() END;
+
+CREATE TABLE bench_archive (LIKE bench_events);
+
+VACUUM ANALYZE bench_events;
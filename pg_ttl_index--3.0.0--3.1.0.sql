@@ -0,0 +1,2083 @@
+-- Rule options, state and counters added since 3.0.0
+ALTER TABLE ttl_index_table
+    ADD COLUMN archive_to_file BOOLEAN NOT NULL DEFAULT false,
+    ADD COLUMN archive_table TEXT,
+    ADD COLUMN soft_delete_grace_seconds INTEGER,
+    ADD COLUMN total_rows_purged BIGINT DEFAULT 0,
+    ADD COLUMN purge_index_name TEXT,
+    ADD COLUMN pending_index_ddl TEXT[],
+    -- Scheduling class: high runs first, unthrottled and outside the cycle
+    -- budget; low only runs when higher classes are caught up.
+    ADD COLUMN priority TEXT NOT NULL DEFAULT 'normal' CHECK (priority IN ('high', 'normal', 'low')),
+    -- Seconds the oldest remaining expired row is past its cutoff
+    ADD COLUMN expiry_lag_seconds BIGINT,
+    -- Set when load-aware scheduling first defers the rule and cleared once
+    -- a pass finishes; while set, batches are scaled to catch up.
+    ADD COLUMN deferred_since TIMESTAMPTZ,
+    -- Daily window such as '02:00-05:00 UTC' in which the rule runs
+    -- unthrottled; with run_only_in_window it never runs outside it.
+    ADD COLUMN maintenance_window TEXT,
+    ADD COLUMN run_only_in_window BOOLEAN NOT NULL DEFAULT false,
+    -- column_name holds an expression over the row rather than a column
+    ADD COLUMN is_expression BOOLEAN NOT NULL DEFAULT false,
+    -- How the runner renders the cutoff: a timestamp, a date or a unix
+    -- epoch in seconds, milliseconds or microseconds.
+    ADD COLUMN ttl_column_type TEXT NOT NULL DEFAULT 'timestamptz'
+        CHECK (ttl_column_type IN ('timestamptz', 'timestamp', 'date', 'epoch_s', 'epoch_ms', 'epoch_us')),
+    -- Optional WHERE predicate restricting the rule to some rows; several
+    -- rules may share a column with different filters. Empty means all rows.
+    ADD COLUMN row_filter TEXT NOT NULL DEFAULT '',
+    -- Per-group retention: seconds are looked up in retention_table by the
+    -- group column's value, falling back to expire_after_seconds.
+    ADD COLUMN group_column TEXT,
+    ADD COLUMN retention_table TEXT,
+    ADD COLUMN retention_column TEXT,
+    -- Position in the ordered groups where the next pass starts, after a
+    -- pass was cut short, so every group gets its turn
+    ADD COLUMN resume_group INTEGER,
+    -- Delete ON DELETE CASCADE children in set-based passes before the parents
+    ADD COLUMN cascade_children BOOLEAN NOT NULL DEFAULT false,
+    -- Run batches with session_replication_role = replica (no triggers)
+    ADD COLUMN disable_triggers BOOLEAN NOT NULL DEFAULT false,
+    -- Replication origin the rule's changes are tagged with, so logical
+    -- decoding consumers can filter them out
+    ADD COLUMN replication_origin TEXT,
+    -- EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) of the last sampled batch
+    ADD COLUMN last_plan JSONB,
+    ADD COLUMN last_plan_at TIMESTAMPTZ,
+    -- Counters and gauges for ttl_metrics()
+    ADD COLUMN total_batches BIGINT NOT NULL DEFAULT 0,
+    ADD COLUMN total_errors BIGINT NOT NULL DEFAULT 0,
+    ADD COLUMN last_pass_seconds DOUBLE PRECISION,
+    ADD COLUMN total_pass_seconds DOUBLE PRECISION NOT NULL DEFAULT 0,
+    ADD COLUMN total_throttle_seconds DOUBLE PRECISION NOT NULL DEFAULT 0,
+    -- Failure backoff: a failing rule is not retried before next_attempt_at
+    -- and is skipped altogether once quarantined.
+    ADD COLUMN consecutive_failures INTEGER NOT NULL DEFAULT 0,
+    ADD COLUMN next_attempt_at TIMESTAMPTZ,
+    ADD COLUMN quarantined_at TIMESTAMPTZ,
+    ADD COLUMN last_error TEXT,
+    ADD COLUMN last_error_at TIMESTAMPTZ;
+
+-- Several rules may share a column with different row filters, so the
+-- filter joins the primary key.
+ALTER TABLE ttl_index_table
+    DROP CONSTRAINT ttl_index_table_pkey,
+    ADD PRIMARY KEY (schema_name, table_name, column_name, row_filter);
+
+-- Existing rules on timestamp and date columns get their cutoff rendered in
+-- the column's own type.
+UPDATE ttl_index_table t
+SET ttl_column_type = ty.typname
+FROM pg_catalog.pg_namespace n
+JOIN pg_catalog.pg_class c
+  ON c.relnamespace = n.oid
+JOIN pg_catalog.pg_attribute a
+  ON a.attrelid = c.oid
+JOIN pg_catalog.pg_type ty
+  ON ty.oid = a.atttypid
+WHERE n.nspname = t.schema_name
+  AND c.relname = t.table_name
+  AND a.attname = t.column_name
+  AND NOT a.attisdropped
+  AND ty.typname IN ('timestamp', 'date');
+
+-- Per-phase timing of recent ttl_runner() calls, kept while
+-- pg_ttl_index.profile is on (see ttl_last_run_profile())
+CREATE TABLE ttl_run_profile (
+    run_at TIMESTAMPTZ NOT NULL,
+    phase TEXT NOT NULL,
+    calls BIGINT NOT NULL,
+    wall_ms DOUBLE PRECISION NOT NULL,
+    cpu_ms DOUBLE PRECISION NOT NULL
+);
+
+-- Functions changed since 3.0.0 are replaced
+DROP FUNCTION ttl_create_index(TEXT, TEXT, INTEGER, INTEGER, TEXT);
+DROP FUNCTION ttl_drop_index(TEXT, TEXT);
+DROP FUNCTION ttl_runner();
+DROP FUNCTION ttl_summary();
+
+-- Create TTL index with auto-indexing
+CREATE FUNCTION ttl_create_index(
+    p_table_name TEXT,
+    p_column_name TEXT,
+    p_expire_after_seconds INTEGER,
+    p_batch_size INTEGER DEFAULT 10000,
+    p_soft_delete_column TEXT DEFAULT NULL,
+    p_archive_to_file BOOLEAN DEFAULT false,
+    p_archive_table TEXT DEFAULT NULL,
+    p_soft_delete_grace_seconds INTEGER DEFAULT NULL,
+    p_concurrently BOOLEAN DEFAULT false,
+    p_priority TEXT DEFAULT 'normal',
+    p_maintenance_window TEXT DEFAULT NULL,
+    p_run_only_in_window BOOLEAN DEFAULT false,
+    p_epoch_unit TEXT DEFAULT NULL,
+    p_row_filter TEXT DEFAULT '',
+    p_group_column TEXT DEFAULT NULL,
+    p_retention_table TEXT DEFAULT NULL,
+    p_retention_column TEXT DEFAULT 'seconds',
+    p_cascade_children BOOLEAN DEFAULT false,
+    p_disable_triggers BOOLEAN DEFAULT false,
+    p_replication_origin TEXT DEFAULT NULL
+) RETURNS BOOLEAN
+LANGUAGE plpgsql
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_idx_name TEXT;
+    v_generated_idx_name TEXT;
+    v_existing_idx_name TEXT;
+    v_prev_idx_name TEXT;
+    v_prev_index_created_by_extension BOOLEAN;
+    v_index_created_by_extension BOOLEAN;
+    v_table_oid OID;
+    v_table_schema TEXT;
+    v_table_name TEXT;
+    v_column_exists BOOLEAN;
+    v_ttl_type REGTYPE;
+    v_ttl_column_type TEXT;
+    v_row_filter TEXT := COALESCE(pg_catalog.btrim(p_row_filter), '');
+    v_prev_soft_delete_column TEXT;
+    v_group_attnum SMALLINT;
+    v_retention_oid OID;
+    v_retention_table TEXT;
+    v_prev_group_column TEXT;
+    v_index_key TEXT;
+    v_fk TEXT;
+    v_soft_delete_typname TEXT;
+    v_soft_delete_attnum SMALLINT;
+    v_archive_oid OID;
+    v_archive_table TEXT;
+    v_index_predicate TEXT;
+    v_index_where TEXT;
+    v_prev_predicate TEXT;
+    v_prev_purge_idx_name TEXT;
+    v_prev_purge_column TEXT;
+    v_purge_idx_name TEXT;
+    v_create_index TEXT;
+    v_index_ddl TEXT[] := '{}';
+    v_ddl TEXT;
+    v_is_expression BOOLEAN := false;
+    v_ttl_sql TEXT;
+BEGIN
+    IF p_table_name IS NULL OR p_table_name = '' THEN
+        RAISE EXCEPTION 'Table name cannot be empty';
+    END IF;
+
+    IF p_column_name IS NULL OR p_column_name = '' THEN
+        RAISE EXCEPTION 'Column name cannot be empty';
+    END IF;
+
+    IF p_batch_size <= 0 THEN
+        RAISE EXCEPTION 'Batch size must be greater than 0';
+    END IF;
+
+    IF p_expire_after_seconds < 0 THEN
+        RAISE EXCEPTION 'expire_after_seconds must be >= 0';
+    END IF;
+
+    IF p_priority IS NULL OR p_priority NOT IN ('high', 'normal', 'low') THEN
+        RAISE EXCEPTION 'Priority must be high, normal or low';
+    END IF;
+
+    IF p_maintenance_window IS NOT NULL THEN
+        PERFORM ttl_window_state(p_maintenance_window, NOW());
+    ELSIF p_run_only_in_window THEN
+        RAISE EXCEPTION 'run_only_in_window requires maintenance_window';
+    END IF;
+
+    IF p_archive_to_file AND p_soft_delete_column IS NOT NULL THEN
+        RAISE EXCEPTION 'archive_to_file cannot be combined with soft_delete_column';
+    END IF;
+
+    IF p_archive_table IS NOT NULL AND (p_archive_to_file OR p_soft_delete_column IS NOT NULL) THEN
+        RAISE EXCEPTION 'archive_table cannot be combined with archive_to_file or soft_delete_column';
+    END IF;
+
+    IF p_cascade_children AND p_soft_delete_column IS NOT NULL THEN
+        RAISE EXCEPTION 'cascade_children cannot be combined with soft_delete_column';
+    END IF;
+
+    IF p_soft_delete_grace_seconds IS NOT NULL THEN
+        IF p_soft_delete_column IS NULL THEN
+            RAISE EXCEPTION 'soft_delete_grace_seconds requires soft_delete_column';
+        END IF;
+
+        IF p_soft_delete_grace_seconds < 0 THEN
+            RAISE EXCEPTION 'soft_delete_grace_seconds must be >= 0';
+        END IF;
+    END IF;
+
+    v_table_oid := pg_catalog.to_regclass(p_table_name);
+    IF v_table_oid IS NULL THEN
+        RAISE EXCEPTION 'Table "%" was not found. Use a schema-qualified name (e.g. myschema.mytable).',
+                        p_table_name;
+    END IF;
+
+    SELECT n.nspname, c.relname
+    INTO v_table_schema, v_table_name
+    FROM pg_catalog.pg_class c
+    JOIN pg_catalog.pg_namespace n
+      ON n.oid = c.relnamespace
+    WHERE c.oid = v_table_oid
+      AND c.relkind IN ('r', 'p');
+
+    IF v_table_schema IS NULL THEN
+        RAISE EXCEPTION 'Object "%" is not a regular or partitioned table', p_table_name;
+    END IF;
+
+    SELECT a.atttypid
+    INTO v_ttl_type
+    FROM pg_catalog.pg_attribute a
+    WHERE a.attrelid = v_table_oid
+      AND a.attname = p_column_name
+      AND a.attnum > 0
+      AND NOT a.attisdropped;
+    v_column_exists := FOUND;
+
+    IF v_column_exists THEN
+        v_ttl_sql := format('%I', p_column_name);
+    ELSE
+        -- Anything that is not a column is taken as an expression over the
+        -- row, e.g. COALESCE(updated_at, created_at). It is indexed, so it
+        -- must be immutable, and is used as (<expression>) in generated SQL.
+        PERFORM ttl_check_expression(p_column_name, 'TTL expression');
+
+        BEGIN
+            EXECUTE format('SELECT pg_catalog.pg_typeof(%s) FROM (SELECT (NULL::%I.%I).*) r',
+                           p_column_name, v_table_schema, v_table_name)
+            INTO v_ttl_type;
+        EXCEPTION WHEN syntax_error OR undefined_column OR undefined_function THEN
+            RAISE EXCEPTION 'Column "%" does not exist on table %.% and is not a valid expression: %',
+                            p_column_name, v_table_schema, v_table_name, SQLERRM;
+        END;
+
+        v_is_expression := true;
+        v_ttl_sql := '(' || p_column_name || ')';
+    END IF;
+
+    -- The runner compares against a cutoff of the column's own type, so
+    -- integer columns need to say which unix epoch unit they hold.
+    IF v_ttl_type IN ('int2'::REGTYPE, 'int4'::REGTYPE, 'int8'::REGTYPE, 'numeric'::REGTYPE) THEN
+        IF p_epoch_unit IS NULL OR p_epoch_unit NOT IN ('s', 'ms', 'us') THEN
+            RAISE EXCEPTION 'Integer TTL column "%" requires p_epoch_unit (s, ms or us)', p_column_name;
+        END IF;
+        v_ttl_column_type := 'epoch_' || p_epoch_unit;
+    ELSIF p_epoch_unit IS NOT NULL THEN
+        RAISE EXCEPTION 'p_epoch_unit only applies to integer TTL columns';
+    ELSE
+        v_ttl_column_type := CASE v_ttl_type
+                                 WHEN 'timestamptz'::REGTYPE THEN 'timestamptz'
+                                 WHEN 'timestamp'::REGTYPE THEN 'timestamp'
+                                 WHEN 'date'::REGTYPE THEN 'date'
+                             END;
+        IF v_ttl_column_type IS NULL THEN
+            RAISE EXCEPTION 'TTL column "%" must be timestamp, timestamptz, date or an integer epoch, not %',
+                            p_column_name, v_ttl_type;
+        END IF;
+    END IF;
+
+    IF p_soft_delete_column IS NOT NULL THEN
+        IF p_soft_delete_column = p_column_name THEN
+            RAISE EXCEPTION 'soft_delete_column cannot be the same as TTL column';
+        END IF;
+
+        SELECT t.typname, a.attnum
+        INTO v_soft_delete_typname, v_soft_delete_attnum
+        FROM pg_catalog.pg_attribute a
+        JOIN pg_catalog.pg_type t
+          ON t.oid = a.atttypid
+        WHERE a.attrelid = v_table_oid
+          AND a.attname = p_soft_delete_column
+          AND a.attnum > 0
+          AND NOT a.attisdropped;
+
+        IF v_soft_delete_typname IS NULL THEN
+            RAISE EXCEPTION 'Soft delete column "%" does not exist on table %.%',
+                            p_soft_delete_column, v_table_schema, v_table_name;
+        END IF;
+
+        IF v_soft_delete_typname NOT IN ('timestamp', 'timestamptz') THEN
+            RAISE EXCEPTION 'Soft delete column "%" must be timestamp or timestamptz',
+                            p_soft_delete_column;
+        END IF;
+    END IF;
+
+    IF p_archive_table IS NOT NULL THEN
+        v_archive_oid := pg_catalog.to_regclass(p_archive_table);
+        IF v_archive_oid IS NULL THEN
+            RAISE EXCEPTION 'Archive table "%" was not found', p_archive_table;
+        END IF;
+
+        IF v_archive_oid = v_table_oid THEN
+            RAISE EXCEPTION 'archive_table cannot be the TTL table itself';
+        END IF;
+
+        SELECT pg_catalog.format('%I.%I', n.nspname, c.relname)
+        INTO v_archive_table
+        FROM pg_catalog.pg_class c
+        JOIN pg_catalog.pg_namespace n
+          ON n.oid = c.relnamespace
+        WHERE c.oid = v_archive_oid
+          AND c.relkind IN ('r', 'p');
+
+        IF v_archive_table IS NULL THEN
+            RAISE EXCEPTION 'Archive table "%" is not a regular or partitioned table', p_archive_table;
+        END IF;
+
+        -- The runner moves rows with INSERT ... SELECT *, so the row types
+        -- must line up. Planning an empty insert checks that up front.
+        EXECUTE format('INSERT INTO %s SELECT * FROM %I.%I WHERE false',
+                       v_archive_table, v_table_schema, v_table_name);
+    END IF;
+
+    IF p_cascade_children THEN
+        IF ttl_cascade_ctes(v_table_oid) IS NULL THEN
+            RAISE EXCEPTION 'Table %.% has no ON DELETE CASCADE foreign keys referencing it',
+                            v_table_schema, v_table_name;
+        END IF;
+
+        -- Child passes are index-driven only if the referencing columns
+        -- lead some index on the child.
+        FOR v_fk IN
+            SELECT pg_catalog.format('%I on %s', con.conname, con.conrelid::REGCLASS)
+            FROM pg_catalog.pg_constraint con
+            WHERE con.contype = 'f'
+              AND con.confrelid = v_table_oid
+              AND con.confdeltype = 'c'
+              AND con.conrelid <> con.confrelid
+              AND con.conparentid = 0
+              AND NOT EXISTS (
+                  SELECT 1
+                  FROM pg_catalog.pg_index i
+                  WHERE i.indrelid = con.conrelid
+                    AND (pg_catalog.string_to_array(i.indkey::TEXT, ' ')::SMALLINT[])
+                            [1:pg_catalog.cardinality(con.conkey)] @> con.conkey
+              )
+            ORDER BY 1
+        LOOP
+            RAISE WARNING 'Foreign key % has no index on its referencing columns; expiring its rows will scan the table',
+                          v_fk;
+        END LOOP;
+    END IF;
+
+    IF p_disable_triggers THEN
+        -- The runner may be the superuser-owned worker, so only roles that
+        -- could switch triggers off themselves may ask for it.
+        BEGIN
+            PERFORM pg_catalog.set_config('session_replication_role',
+                                          pg_catalog.current_setting('session_replication_role'), true);
+        EXCEPTION
+            WHEN insufficient_privilege THEN
+                RAISE EXCEPTION 'disable_triggers requires permission to set session_replication_role';
+        END;
+
+        -- Replica mode also skips foreign key actions. Only direct
+        -- ON DELETE CASCADE children deleted by cascade_children are safe.
+        IF EXISTS (
+            SELECT 1
+            FROM pg_catalog.pg_constraint con
+            WHERE con.contype = 'f'
+              AND con.conparentid = 0
+              AND ((con.confrelid = v_table_oid
+                    AND NOT (p_cascade_children AND con.confdeltype = 'c'
+                             AND con.conrelid <> con.confrelid))
+                   OR (p_cascade_children
+                       AND con.confrelid IN (SELECT child.conrelid
+                                             FROM pg_catalog.pg_constraint child
+                                             WHERE child.contype = 'f'
+                                               AND child.confrelid = v_table_oid
+                                               AND child.confdeltype = 'c'
+                                               AND child.conrelid <> child.confrelid)))
+        ) THEN
+            RAISE EXCEPTION 'disable_triggers would skip foreign key actions on rows referencing %.%',
+                            v_table_schema, v_table_name;
+        END IF;
+    END IF;
+
+    IF p_replication_origin IS NOT NULL THEN
+        BEGIN
+            IF pg_catalog.pg_replication_origin_oid(p_replication_origin) IS NULL THEN
+                PERFORM pg_catalog.pg_replication_origin_create(p_replication_origin);
+            END IF;
+        EXCEPTION
+            WHEN insufficient_privilege THEN
+                RAISE EXCEPTION 'replication_origin requires permission to use the replication origin functions';
+        END;
+    END IF;
+
+    IF (p_group_column IS NULL) <> (p_retention_table IS NULL) THEN
+        RAISE EXCEPTION 'group_column and retention_table must be given together';
+    END IF;
+
+    IF p_group_column IS NOT NULL THEN
+        IF v_is_expression OR p_soft_delete_column IS NOT NULL THEN
+            RAISE EXCEPTION 'group_column cannot be combined with a TTL expression or soft_delete_column';
+        END IF;
+
+        SELECT a.attnum
+        INTO v_group_attnum
+        FROM pg_catalog.pg_attribute a
+        WHERE a.attrelid = v_table_oid
+          AND a.attname = p_group_column
+          AND a.attnum > 0
+          AND NOT a.attisdropped;
+
+        IF v_group_attnum IS NULL THEN
+            RAISE EXCEPTION 'Group column "%" does not exist on table %.%',
+                            p_group_column, v_table_schema, v_table_name;
+        END IF;
+
+        v_retention_oid := pg_catalog.to_regclass(p_retention_table);
+        IF v_retention_oid IS NULL THEN
+            RAISE EXCEPTION 'Retention table "%" was not found', p_retention_table;
+        END IF;
+
+        SELECT pg_catalog.format('%I.%I', n.nspname, c.relname)
+        INTO v_retention_table
+        FROM pg_catalog.pg_class c
+        JOIN pg_catalog.pg_namespace n
+          ON n.oid = c.relnamespace
+        WHERE c.oid = v_retention_oid;
+
+        -- The runner joins the map on the group column's name and reads the
+        -- retention in seconds from p_retention_column.
+        EXECUTE format('SELECT m.%I, m.%I::BIGINT FROM %s m LIMIT 0',
+                       p_group_column, p_retention_column, v_retention_table);
+    END IF;
+
+    IF v_row_filter <> '' THEN
+        -- The runner appends the filter as AND (<filter>).
+        PERFORM ttl_check_expression(v_row_filter, 'Row filter');
+
+        BEGIN
+            EXECUTE format('SELECT 1 FROM %I.%I WHERE (%s) LIMIT 0',
+                           v_table_schema, v_table_name, v_row_filter);
+        EXCEPTION WHEN syntax_error OR undefined_column OR undefined_function OR datatype_mismatch THEN
+            RAISE EXCEPTION 'Invalid row filter "%": %', v_row_filter, SQLERRM;
+        END;
+    END IF;
+
+    -- Soft-delete rules only ever scan unmarked rows, so their TTL index is
+    -- partial and excludes rows that were already soft-deleted.
+    IF p_soft_delete_column IS NOT NULL THEN
+        v_index_predicate := format('(%I IS NULL)', p_soft_delete_column);
+        v_index_where := format(' WHERE %I IS NULL', p_soft_delete_column);
+    ELSE
+        v_index_where := '';
+    END IF;
+
+    -- Filtered rules only scan their own rows, so the filter joins the
+    -- index predicate.
+    IF v_row_filter <> '' THEN
+        v_index_where := CASE WHEN v_index_where = '' THEN ' WHERE ' ELSE v_index_where || ' AND ' END
+                         || '(' || v_row_filter || ')';
+    END IF;
+
+    -- Concurrent builds cannot run inside this transaction; they are queued
+    -- for the background worker instead.
+    v_create_index := CASE WHEN p_concurrently
+                           THEN 'CREATE INDEX CONCURRENTLY IF NOT EXISTS'
+                           ELSE 'CREATE INDEX IF NOT EXISTS' END;
+
+    -- Grouped rules scan (group, TTL column) ranges.
+    v_index_key := CASE WHEN p_group_column IS NOT NULL
+                        THEN format('%I, %s', p_group_column, v_ttl_sql)
+                        ELSE v_ttl_sql END;
+
+    -- Create index name
+    v_generated_idx_name := 'idx_ttl_' || v_table_name || '_'
+                            || CASE WHEN p_group_column IS NOT NULL THEN p_group_column || '_' ELSE '' END
+                            || CASE WHEN v_is_expression
+                                    THEN 'expr_' || pg_catalog.left(pg_catalog.md5(p_column_name), 8)
+                                    ELSE p_column_name END
+                            || CASE WHEN v_row_filter <> ''
+                                    THEN '_f' || pg_catalog.left(pg_catalog.md5(v_row_filter), 8)
+                                    ELSE '' END
+                            || CASE WHEN p_soft_delete_column IS NOT NULL THEN '_live' ELSE '' END;
+
+    -- Keep ownership stable across repeated updates.
+    SELECT index_name, index_created_by_extension, purge_index_name, soft_delete_column, group_column
+    INTO v_prev_idx_name, v_prev_index_created_by_extension, v_prev_purge_idx_name,
+         v_prev_soft_delete_column, v_prev_group_column
+    FROM ttl_index_table
+    WHERE ttl_index_table.schema_name = v_table_schema
+      AND ttl_index_table.table_name = v_table_name
+      AND ttl_index_table.column_name = p_column_name
+      AND ttl_index_table.row_filter = v_row_filter;
+
+    IF COALESCE(v_prev_index_created_by_extension, false) THEN
+        -- Rebuild the owned index if the rule switched between hard and
+        -- soft delete (or to another soft delete column).
+        SELECT pg_catalog.pg_get_expr(i.indpred, i.indrelid)
+        INTO v_prev_predicate
+        FROM pg_catalog.pg_index i
+        JOIN pg_catalog.pg_class idx
+          ON idx.oid = i.indexrelid
+        WHERE i.indrelid = v_table_oid
+          AND idx.relname = v_prev_idx_name;
+
+        -- A filtered index predicate is printed in PostgreSQL's own form, so
+        -- for those compare the soft delete column instead.
+        IF FOUND AND (CASE WHEN v_row_filter = ''
+                           THEN v_prev_predicate IS DISTINCT FROM v_index_predicate
+                           ELSE v_prev_soft_delete_column IS DISTINCT FROM p_soft_delete_column END
+                      OR v_prev_group_column IS DISTINCT FROM p_group_column) THEN
+            EXECUTE format('DROP INDEX %I.%I', v_table_schema, v_prev_idx_name);
+            v_prev_idx_name := v_generated_idx_name;
+        END IF;
+
+        v_idx_name := COALESCE(v_prev_idx_name, v_generated_idx_name);
+        v_index_ddl := v_index_ddl || format('%s %I ON %I.%I (%s)%s', v_create_index,
+                                             v_idx_name, v_table_schema, v_table_name,
+                                             v_index_key, v_index_where);
+        v_index_created_by_extension := true;
+    ELSE
+        -- Reuse any existing valid/ready index that already includes the TTL
+        -- column and has the predicate this rule needs (none for hard delete).
+        -- Expression rules reuse an index whose leading key is written the
+        -- same way. Filtered rules reuse a partial index on exactly the
+        -- filter, or a composite index whose leading column the filter
+        -- names followed by the TTL column, e.g. (tenant_id, created_at).
+        -- Grouped rules need the group column first and the TTL column
+        -- second.
+        SELECT idx.relname
+        INTO v_existing_idx_name
+        FROM pg_catalog.pg_index i
+        JOIN pg_catalog.pg_class idx
+          ON idx.oid = i.indexrelid
+        LEFT JOIN pg_catalog.pg_attribute a
+          ON a.attrelid = i.indrelid
+         AND a.attnum = ANY(i.indkey)
+         AND a.attname = p_column_name
+        WHERE i.indrelid = v_table_oid
+          AND CASE WHEN v_group_attnum IS NOT NULL
+                   THEN i.indkey[0] = v_group_attnum AND a.attnum = i.indkey[1]
+                   WHEN v_is_expression
+                   THEN i.indkey[0] = 0
+                        AND pg_catalog.pg_get_indexdef(i.indexrelid, 1, false)
+                            IN (p_column_name, v_ttl_sql)
+                   ELSE a.attnum IS NOT NULL END
+          AND i.indisvalid
+          AND i.indisready
+          AND CASE WHEN v_row_filter = ''
+                   THEN pg_catalog.pg_get_expr(i.indpred, i.indrelid) IS NOT DISTINCT FROM v_index_predicate
+                   ELSE (p_soft_delete_column IS NULL
+                         AND pg_catalog.pg_get_expr(i.indpred, i.indrelid)
+                             IN (v_row_filter, '(' || v_row_filter || ')'))
+                        OR (pg_catalog.pg_get_expr(i.indpred, i.indrelid) IS NOT DISTINCT FROM v_index_predicate
+                            AND i.indnkeyatts >= 2
+                            AND a.attnum = i.indkey[1]
+                            AND v_row_filter ~ ('\m' || (SELECT f.attname
+                                                         FROM pg_catalog.pg_attribute f
+                                                         WHERE f.attrelid = i.indrelid
+                                                           AND f.attnum = i.indkey[0]) || '\M'))
+              END
+        ORDER BY idx.relname
+        LIMIT 1;
+
+        IF v_existing_idx_name IS NOT NULL THEN
+            v_idx_name := v_existing_idx_name;
+            v_index_created_by_extension := false;
+        ELSE
+            v_idx_name := v_generated_idx_name;
+            v_index_ddl := v_index_ddl || format('%s %I ON %I.%I (%s)%s', v_create_index,
+                                                 v_idx_name, v_table_schema, v_table_name,
+                                                 v_index_key, v_index_where);
+            v_index_created_by_extension := true;
+        END IF;
+    END IF;
+
+    -- The purge phase reads only marked rows, which the partial TTL index
+    -- excludes; give it an index on the soft delete column unless one exists.
+    IF v_prev_purge_idx_name IS NOT NULL THEN
+        SELECT a.attname
+        INTO v_prev_purge_column
+        FROM pg_catalog.pg_index i
+        JOIN pg_catalog.pg_class idx
+          ON idx.oid = i.indexrelid
+        JOIN pg_catalog.pg_attribute a
+          ON a.attrelid = i.indrelid
+         AND a.attnum = i.indkey[0]
+        WHERE i.indrelid = v_table_oid
+          AND idx.relname = v_prev_purge_idx_name;
+
+        IF p_soft_delete_grace_seconds IS NULL
+           OR v_prev_purge_column IS DISTINCT FROM p_soft_delete_column THEN
+            EXECUTE format('DROP INDEX IF EXISTS %I.%I', v_table_schema, v_prev_purge_idx_name);
+        ELSE
+            v_purge_idx_name := v_prev_purge_idx_name;
+        END IF;
+    END IF;
+
+    IF p_soft_delete_grace_seconds IS NOT NULL AND v_purge_idx_name IS NULL THEN
+        IF NOT EXISTS (
+            SELECT 1
+            FROM pg_catalog.pg_index i
+            WHERE i.indrelid = v_table_oid
+              AND i.indkey[0] = v_soft_delete_attnum
+              AND i.indisvalid
+              AND i.indisready
+              AND (i.indpred IS NULL
+                   OR pg_catalog.pg_get_expr(i.indpred, i.indrelid)
+                      = format('(%I IS NOT NULL)', p_soft_delete_column))
+        ) THEN
+            v_purge_idx_name := 'idx_ttl_' || v_table_name || '_' || p_soft_delete_column || '_purge';
+        END IF;
+    END IF;
+
+    IF v_purge_idx_name IS NOT NULL THEN
+        v_index_ddl := v_index_ddl || format('%s %I ON %I.%I (%I) WHERE %I IS NOT NULL',
+                                             v_create_index, v_purge_idx_name,
+                                             v_table_schema, v_table_name,
+                                             p_soft_delete_column, p_soft_delete_column);
+    END IF;
+
+    -- With p_concurrently the rule stays inactive until ttl_runner() sees
+    -- that every queued index is valid.
+    IF NOT p_concurrently THEN
+        FOREACH v_ddl IN ARRAY v_index_ddl LOOP
+            EXECUTE v_ddl;
+        END LOOP;
+        v_index_ddl := '{}';
+    END IF;
+
+    -- Insert or update TTL configuration
+    INSERT INTO ttl_index_table (schema_name, table_name, column_name, expire_after_seconds,
+                                 batch_size, index_name, soft_delete_column,
+                                 index_created_by_extension, archive_to_file, archive_table,
+                                 soft_delete_grace_seconds, purge_index_name, pending_index_ddl,
+                                 priority, maintenance_window, run_only_in_window, is_expression,
+                                 ttl_column_type, row_filter, group_column, retention_table,
+                                 retention_column, cascade_children, disable_triggers,
+                                 replication_origin, active, created_at)
+    VALUES (v_table_schema, v_table_name, p_column_name, p_expire_after_seconds,
+            p_batch_size, v_idx_name, p_soft_delete_column, v_index_created_by_extension,
+            p_archive_to_file, v_archive_table, p_soft_delete_grace_seconds, v_purge_idx_name,
+            NULLIF(v_index_ddl, '{}'), p_priority, p_maintenance_window, p_run_only_in_window,
+            v_is_expression, v_ttl_column_type, v_row_filter, p_group_column, v_retention_table,
+            CASE WHEN p_group_column IS NOT NULL THEN p_retention_column END, p_cascade_children,
+            p_disable_triggers, p_replication_origin, v_index_ddl = '{}', NOW())
+    ON CONFLICT (schema_name, table_name, column_name, row_filter) DO UPDATE SET
+        expire_after_seconds = p_expire_after_seconds,
+        batch_size = p_batch_size,
+        index_name = EXCLUDED.index_name,
+        soft_delete_column = EXCLUDED.soft_delete_column,
+        index_created_by_extension = EXCLUDED.index_created_by_extension,
+        archive_to_file = EXCLUDED.archive_to_file,
+        archive_table = EXCLUDED.archive_table,
+        soft_delete_grace_seconds = EXCLUDED.soft_delete_grace_seconds,
+        purge_index_name = EXCLUDED.purge_index_name,
+        pending_index_ddl = EXCLUDED.pending_index_ddl,
+        priority = EXCLUDED.priority,
+        maintenance_window = EXCLUDED.maintenance_window,
+        run_only_in_window = EXCLUDED.run_only_in_window,
+        is_expression = EXCLUDED.is_expression,
+        ttl_column_type = EXCLUDED.ttl_column_type,
+        group_column = EXCLUDED.group_column,
+        retention_table = EXCLUDED.retention_table,
+        retention_column = EXCLUDED.retention_column,
+        cascade_children = EXCLUDED.cascade_children,
+        disable_triggers = EXCLUDED.disable_triggers,
+        replication_origin = EXCLUDED.replication_origin,
+        active = EXCLUDED.active,
+        consecutive_failures = 0,
+        next_attempt_at = NULL,
+        quarantined_at = NULL,
+        updated_at = NOW();
+
+    RETURN true;
+EXCEPTION WHEN OTHERS THEN
+    RAISE WARNING 'TTL create_index failed: % (%)', SQLERRM, SQLSTATE;
+    RETURN false;
+END;
+$$;
+
+-- Drop TTL index and cleanup
+CREATE FUNCTION ttl_drop_index(
+    p_table_name TEXT,
+    p_column_name TEXT,
+    p_row_filter TEXT DEFAULT ''
+) RETURNS BOOLEAN
+LANGUAGE plpgsql
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_idx_name TEXT;
+    v_index_created_by_extension BOOLEAN;
+    v_purge_idx_name TEXT;
+    v_table_oid OID;
+    v_table_schema TEXT;
+    v_table_name TEXT;
+    v_row_filter TEXT := COALESCE(pg_catalog.btrim(p_row_filter), '');
+BEGIN
+    IF p_table_name IS NULL OR p_table_name = '' THEN
+        RAISE EXCEPTION 'Table name cannot be empty';
+    END IF;
+
+    IF p_column_name IS NULL OR p_column_name = '' THEN
+        RAISE EXCEPTION 'Column name cannot be empty';
+    END IF;
+
+    v_table_oid := pg_catalog.to_regclass(p_table_name);
+    IF v_table_oid IS NULL THEN
+        RAISE EXCEPTION 'Table "%" was not found. Use a schema-qualified name (e.g. myschema.mytable).',
+                        p_table_name;
+    END IF;
+
+    SELECT n.nspname, c.relname
+    INTO v_table_schema, v_table_name
+    FROM pg_catalog.pg_class c
+    JOIN pg_catalog.pg_namespace n
+      ON n.oid = c.relnamespace
+    WHERE c.oid = v_table_oid;
+
+    -- Get index ownership details.
+    SELECT index_name, index_created_by_extension, purge_index_name
+    INTO v_idx_name, v_index_created_by_extension, v_purge_idx_name
+    FROM ttl_index_table
+    WHERE ttl_index_table.schema_name = v_table_schema
+      AND ttl_index_table.table_name = v_table_name
+      AND ttl_index_table.column_name = p_column_name
+      AND ttl_index_table.row_filter = v_row_filter;
+
+    -- Drop only indexes managed by this extension.
+    IF v_idx_name IS NOT NULL AND COALESCE(v_index_created_by_extension, false) THEN
+        EXECUTE format('DROP INDEX IF EXISTS %I.%I', v_table_schema, v_idx_name);
+    END IF;
+
+    -- The purge index is only recorded when the extension created it.
+    IF v_purge_idx_name IS NOT NULL THEN
+        EXECUTE format('DROP INDEX IF EXISTS %I.%I', v_table_schema, v_purge_idx_name);
+    END IF;
+
+    -- Delete the configuration
+    DELETE FROM ttl_index_table
+    WHERE ttl_index_table.schema_name = v_table_schema
+      AND ttl_index_table.table_name = v_table_name
+      AND ttl_index_table.column_name = p_column_name
+      AND ttl_index_table.row_filter = v_row_filter;
+
+    RETURN FOUND;
+END;
+$$;
+
+-- Clears a rule's failure backoff and quarantine, so the next run retries it
+CREATE FUNCTION ttl_release_rule(
+    p_table_name TEXT,
+    p_column_name TEXT,
+    p_row_filter TEXT DEFAULT ''
+) RETURNS BOOLEAN
+LANGUAGE plpgsql
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_table_oid OID;
+    v_table_schema TEXT;
+    v_table_name TEXT;
+    v_row_filter TEXT := COALESCE(pg_catalog.btrim(p_row_filter), '');
+BEGIN
+    v_table_oid := pg_catalog.to_regclass(p_table_name);
+    IF v_table_oid IS NULL THEN
+        RAISE EXCEPTION 'Table "%" was not found. Use a schema-qualified name (e.g. myschema.mytable).',
+                        p_table_name;
+    END IF;
+
+    SELECT n.nspname, c.relname
+    INTO v_table_schema, v_table_name
+    FROM pg_catalog.pg_class c
+    JOIN pg_catalog.pg_namespace n
+      ON n.oid = c.relnamespace
+    WHERE c.oid = v_table_oid;
+
+    UPDATE ttl_index_table
+    SET consecutive_failures = 0,
+        next_attempt_at = NULL,
+        quarantined_at = NULL,
+        updated_at = NOW()
+    WHERE ttl_index_table.schema_name = v_table_schema
+      AND ttl_index_table.table_name = v_table_name
+      AND ttl_index_table.column_name = p_column_name
+      AND ttl_index_table.row_filter = v_row_filter;
+
+    RETURN FOUND;
+END;
+$$;
+
+-- Checks that p_sql is one self-contained expression, so that it can be
+-- spliced into generated statements inside parentheses. Parentheses and
+-- quotes must balance, and ';', comments and dollar quoting are rejected,
+-- since each could end the parentheses or the statement early. A backslash
+-- before a quote is rejected too, so string boundaries do not depend on
+-- standard_conforming_strings. p_what names the argument in errors.
+CREATE FUNCTION ttl_check_expression(p_sql TEXT, p_what TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+IMMUTABLE
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_len INTEGER := pg_catalog.length(p_sql);
+    v_pos INTEGER := 1;
+    v_char TEXT;
+    v_quote TEXT;
+    v_depth INTEGER := 0;
+BEGIN
+    IF pg_catalog.strpos(p_sql, E'\\''') > 0 THEN
+        RAISE EXCEPTION '% "%" must not contain a backslash before a quote', p_what, p_sql;
+    END IF;
+
+    WHILE v_pos <= v_len LOOP
+        v_char := pg_catalog.substr(p_sql, v_pos, 1);
+
+        IF v_quote IS NOT NULL THEN
+            -- A doubled quote closes and reopens, which tracks the same.
+            IF v_char = v_quote THEN
+                v_quote := NULL;
+            END IF;
+        ELSIF v_char IN ('''', '"') THEN
+            v_quote := v_char;
+        ELSIF v_char = ';' THEN
+            RAISE EXCEPTION '% "%" must not contain ";"', p_what, p_sql;
+        ELSIF pg_catalog.substr(p_sql, v_pos, 2) IN ('--', '/*') THEN
+            RAISE EXCEPTION '% "%" must not contain comments', p_what, p_sql;
+        ELSIF v_char = '$'
+              AND (v_pos = 1 OR pg_catalog.substr(p_sql, v_pos - 1, 1) !~ '[[:alnum:]_$]') THEN
+            RAISE EXCEPTION '% "%" must not contain dollar quoting or parameters', p_what, p_sql;
+        ELSIF v_char = '(' THEN
+            v_depth := v_depth + 1;
+        ELSIF v_char = ')' THEN
+            v_depth := v_depth - 1;
+            EXIT WHEN v_depth < 0;
+        END IF;
+
+        v_pos := v_pos + 1;
+    END LOOP;
+
+    IF v_quote IS NOT NULL THEN
+        RAISE EXCEPTION '% "%" has an unterminated quoted string or identifier', p_what, p_sql;
+    END IF;
+
+    IF v_depth <> 0 THEN
+        RAISE EXCEPTION '% "%" has unbalanced parentheses', p_what, p_sql;
+    END IF;
+END;
+$$;
+
+-- Parses a maintenance window such as '02:00-05:00 UTC' and reports whether
+-- p_at falls inside it and when it next opens or closes. The time zone
+-- defaults to the session's; windows may wrap past midnight.
+CREATE FUNCTION ttl_window_state(
+    p_window TEXT,
+    p_at TIMESTAMPTZ,
+    OUT in_window BOOLEAN,
+    OUT next_boundary TIMESTAMPTZ
+)
+LANGUAGE plpgsql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_parts TEXT[];
+    v_zone TEXT;
+    v_start TIME;
+    v_end TIME;
+    v_local TIMESTAMP;
+    v_day TIMESTAMP;
+    v_next TIMESTAMP;
+BEGIN
+    v_parts := pg_catalog.regexp_match(p_window,
+                   '^\s*(\d{1,2}:\d{2})\s*-\s*(\d{1,2}:\d{2})(?:\s+(\S+))?\s*$');
+    IF v_parts IS NULL THEN
+        RAISE EXCEPTION 'Invalid maintenance window "%", expected HH:MM-HH:MM [time zone]', p_window;
+    END IF;
+
+    v_start := v_parts[1]::TIME;
+    v_end := v_parts[2]::TIME;
+    v_zone := COALESCE(v_parts[3], pg_catalog.current_setting('TimeZone'));
+
+    IF v_start = v_end THEN
+        RAISE EXCEPTION 'Maintenance window "%" is empty', p_window;
+    END IF;
+
+    v_local := p_at AT TIME ZONE v_zone;
+    v_day := pg_catalog.date_trunc('day', v_local);
+
+    in_window := CASE WHEN v_start < v_end
+                      THEN v_local::TIME >= v_start AND v_local::TIME < v_end
+                      ELSE v_local::TIME >= v_start OR v_local::TIME < v_end END;
+
+    SELECT pg_catalog.min(b.boundary) INTO v_next
+    FROM pg_catalog.unnest(ARRAY[v_day + v_start, v_day + v_end,
+                                 v_day + INTERVAL '1 day' + v_start,
+                                 v_day + INTERVAL '1 day' + v_end]) AS b(boundary)
+    WHERE b.boundary > v_local;
+
+    next_boundary := v_next AT TIME ZONE v_zone;
+END;
+$$;
+
+-- Earliest time a maintenance window of an active rule, or the database
+-- window, opens or closes. The background worker wakes up then.
+CREATE FUNCTION ttl_next_window_boundary()
+RETURNS TIMESTAMPTZ
+LANGUAGE sql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+    SELECT pg_catalog.min(s.next_boundary)
+    FROM (
+        SELECT t.maintenance_window AS spec
+        FROM ttl_index_table t
+        WHERE t.active AND t.maintenance_window IS NOT NULL
+        UNION
+        SELECT NULLIF(pg_catalog.current_setting('pg_ttl_index.maintenance_window', true), '')
+    ) w,
+    LATERAL ttl_window_state(w.spec, pg_catalog.clock_timestamp()) s
+    WHERE w.spec IS NOT NULL;
+$$;
+
+-- Renders a cutoff as a literal of the TTL column's type (see
+-- ttl_index_table.ttl_column_type), so comparing the column against it is a
+-- plain btree range qual with no per-row casts and no volatile call.
+CREATE FUNCTION ttl_cutoff_literal(p_column_type TEXT, p_cutoff TIMESTAMPTZ)
+RETURNS TEXT
+LANGUAGE sql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+    SELECT CASE p_column_type
+               WHEN 'timestamp' THEN pg_catalog.quote_literal(p_cutoff::TIMESTAMP) || '::TIMESTAMP'
+               -- A day expires once all of it is past the TTL
+               WHEN 'date' THEN pg_catalog.quote_literal(p_cutoff::DATE) || '::DATE'
+               WHEN 'epoch_s'
+               THEN pg_catalog.floor(EXTRACT(EPOCH FROM p_cutoff))::BIGINT::TEXT
+               WHEN 'epoch_ms'
+               THEN pg_catalog.floor(EXTRACT(EPOCH FROM p_cutoff) * 1000)::BIGINT::TEXT
+               WHEN 'epoch_us'
+               THEN pg_catalog.floor(EXTRACT(EPOCH FROM p_cutoff) * 1000000)::BIGINT::TEXT
+               ELSE pg_catalog.quote_literal(p_cutoff) || '::TIMESTAMPTZ'
+           END;
+$$;
+
+-- WITH-list entries that follow the CTE ttl_candidates, the locked batch of
+-- expiring rows of p_relid. Their ON DELETE CASCADE children are locked with
+-- SKIP LOCKED like the parents; ttl_parents keeps the candidates whose
+-- children were all locked, and their children are then deleted with one
+-- set-based DELETE per foreign key. NULL when nothing cascades from the table.
+CREATE FUNCTION ttl_cascade_ctes(p_relid OID)
+RETURNS TEXT
+LANGUAGE sql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+    SELECT pg_catalog.string_agg(
+               pg_catalog.format(', ttl_lock_%s AS (SELECT c.tableoid, c.ctid FROM %s c JOIN ttl_candidates p ON %s FOR UPDATE OF c SKIP LOCKED)',
+                                 fk.n, fk.conrelid::REGCLASS, fk.join_qual),
+               '' ORDER BY fk.n)
+           || ', ttl_parents AS (SELECT * FROM ttl_candidates WHERE ctid <> ALL(ARRAY('
+           || pg_catalog.string_agg(
+                  pg_catalog.format('SELECT p.ctid FROM ttl_candidates p JOIN %s c ON %s WHERE NOT EXISTS (SELECT 1 FROM ttl_lock_%s l WHERE l.tableoid = c.tableoid AND l.ctid = c.ctid)',
+                                    fk.conrelid::REGCLASS, fk.join_qual, fk.n),
+                  ' UNION ALL ' ORDER BY fk.n)
+           || ')))'
+           || pg_catalog.string_agg(
+                  pg_catalog.format(', ttl_child_%s AS (DELETE FROM %s c USING ttl_parents p WHERE %s)',
+                                    fk.n, fk.conrelid::REGCLASS, fk.join_qual),
+                  '' ORDER BY fk.n)
+    FROM (
+        SELECT pg_catalog.row_number() OVER (ORDER BY con.conname, con.oid) AS n,
+               con.conrelid,
+               (SELECT pg_catalog.string_agg(pg_catalog.format('c.%I = p.%I', ca.attname, pa.attname),
+                                             ' AND ' ORDER BY k.ord)
+                FROM ROWS FROM (pg_catalog.unnest(con.conkey), pg_catalog.unnest(con.confkey))
+                     WITH ORDINALITY AS k(child_attnum, parent_attnum, ord)
+                JOIN pg_catalog.pg_attribute ca
+                  ON ca.attrelid = con.conrelid
+                 AND ca.attnum = k.child_attnum
+                JOIN pg_catalog.pg_attribute pa
+                  ON pa.attrelid = con.confrelid
+                 AND pa.attnum = k.parent_attnum) AS join_qual
+        FROM pg_catalog.pg_constraint con
+        WHERE con.contype = 'f'
+          AND con.confrelid = p_relid
+          AND con.confdeltype = 'c'
+          AND con.conrelid <> con.confrelid
+          AND con.conparentid = 0
+    ) fk;
+$$;
+
+-- Optimized TTL runner with batch deletion and per-table transactions
+CREATE OR REPLACE FUNCTION ttl_runner() RETURNS INTEGER
+LANGUAGE plpgsql
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    rec RECORD;
+    batch_deleted INTEGER;
+    table_deleted BIGINT;
+    table_purged BIGINT;
+    total_deleted INTEGER := 0;
+    cleanup_query TEXT;
+    start_time TIMESTAMPTZ;
+    saved_lock_timeout TEXT;
+    saved_replication_role TEXT;
+    ttl_lock_timeout TEXT := COALESCE(pg_catalog.current_setting('pg_ttl_index.lock_timeout', true), '1000');
+    cycle_budget_ms INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.cycle_time_budget', true),
+                                        '0')::INTEGER;
+    rule_quantum_ms INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.rule_time_quantum', true),
+                                        '30000')::INTEGER;
+    cycle_deadline TIMESTAMPTZ;
+    rule_deadline TIMESTAMPTZ;
+    mark_deadline TIMESTAMPTZ;
+    rule_unfinished BOOLEAN;
+    higher_backlog BOOLEAN := false;
+    oldest_value TIMESTAMPTZ;
+    expiry_lag BIGINT;
+    lag_warning_seconds INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.expiry_lag_warning', true),
+                                            '0')::INTEGER;
+    load_watermark INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.load_watermark', true),
+                                       '0')::INTEGER;
+    catchup_factor INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.catchup_batch_factor', true),
+                                       '4')::INTEGER;
+    active_backends INTEGER;
+    load_deferred BOOLEAN := false;
+    batch_factor INTEGER := 1;
+    batch_limit BIGINT;
+    db_window TEXT := NULLIF(pg_catalog.current_setting('pg_ttl_index.maintenance_window', true), '');
+    db_window_only BOOLEAN := COALESCE(pg_catalog.current_setting('pg_ttl_index.maintenance_window_only', true),
+                                       'off')::BOOLEAN;
+    rule_in_window BOOLEAN;
+    rule_unthrottled BOOLEAN;
+    window_end TIMESTAMPTZ;
+    cutoff_ts TIMESTAMPTZ;
+    cutoff_sql TEXT;
+    filter_sql TEXT;
+    scope_sql TEXT;
+    cascade_sql TEXT;
+    group_quals TEXT[];
+    group_seconds BIGINT[];
+    group_count INTEGER;
+    group_step INTEGER;
+    group_idx INTEGER;
+    group_resume INTEGER;
+    profiling BOOLEAN := COALESCE(pg_catalog.current_setting('pg_ttl_index.profile', true),
+                                  'off')::BOOLEAN;
+    explain_rate DOUBLE PRECISION := COALESCE(pg_catalog.current_setting('pg_ttl_index.explain_sample_rate', true),
+                                              '0')::DOUBLE PRECISION;
+    capture_plan BOOLEAN;
+    rule_plan JSONB;
+    rule_started TIMESTAMPTZ;
+    rule_batches BIGINT;
+    rule_throttle INTERVAL;
+    rule_failed BOOLEAN;
+    rule_lock_timeout BOOLEAN;
+    sleep_started TIMESTAMPTZ;
+    log_min_ms INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.log_min_duration', true),
+                                   '-1')::INTEGER;
+    pass_ms DOUBLE PRECISION;
+    pass_io BIGINT[];
+    batch_ms DOUBLE PRECISION;
+    batch_io BIGINT[];
+    batch_started TIMESTAMPTZ;
+    backoff_s INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.failure_backoff', true),
+                                  '60')::INTEGER;
+    max_failures INTEGER := COALESCE(pg_catalog.current_setting('pg_ttl_index.max_consecutive_failures', true),
+                                     '10')::INTEGER;
+    rule_error TEXT;
+    rule_error_state TEXT;
+    rule_failures INTEGER;
+    rule_quarantined BOOLEAN;
+    rules_run INTEGER := 0;
+BEGIN
+    start_time := pg_catalog.clock_timestamp();
+
+    -- Profiling: every statement from here on is charged to the phase last
+    -- started with ttl_profile_phase(). The calls are only made while
+    -- pg_ttl_index.profile is on, so unprofiled runs skip them entirely.
+    IF profiling THEN
+        PERFORM ttl_profile_reset();
+        PERFORM ttl_profile_phase('setup');
+    END IF;
+
+    -- A broken database-wide window must not silently lift the restriction
+    -- it was meant to impose, so skip the run instead.
+    IF db_window IS NOT NULL THEN
+        BEGIN
+            PERFORM ttl_window_state(db_window, start_time);
+        EXCEPTION WHEN OTHERS THEN
+            RAISE WARNING 'TTL runner: invalid pg_ttl_index.maintenance_window: %', SQLERRM;
+            RETURN 0;
+        END;
+    END IF;
+
+    -- Time box: the run stops after the cycle budget and each rule after its
+    -- quantum. Within a priority class rules are visited oldest last_run
+    -- first, so rules this run does not reach are first in line next run
+    -- (round robin). The budget is checked before every rule but the first,
+    -- so each run makes some progress. High-priority rules and rules inside
+    -- their maintenance window are exempt from the budget but not from the
+    -- quantum, which bounds how long one run holds its snapshot.
+    cycle_deadline := CASE WHEN cycle_budget_ms > 0
+                           THEN start_time + pg_catalog.make_interval(secs => cycle_budget_ms / 1000.0)
+                           ELSE 'infinity' END;
+
+    -- Load-aware scheduling: sample busy client backends once per run. At or
+    -- above the watermark only high-priority rules run; at half the watermark
+    -- or below, rules with a deferral backlog get larger batches to catch up.
+    -- A manual call counts its own session; the background worker's is not a
+    -- client backend.
+    IF load_watermark > 0 THEN
+        SELECT pg_catalog.count(*)::INTEGER INTO active_backends
+        FROM pg_catalog.pg_stat_activity
+        WHERE state = 'active'
+          AND backend_type = 'client backend';
+
+        IF active_backends >= load_watermark THEN
+            load_deferred := true;
+            RAISE DEBUG 'TTL runner: % active backends at or above load watermark %, deferring',
+                        active_backends, load_watermark;
+        ELSIF active_backends * 2 <= load_watermark THEN
+            batch_factor := GREATEST(catchup_factor, 1);
+        END IF;
+    END IF;
+
+    -- Never queue behind application locks for long. Candidate rows are
+    -- picked with SKIP LOCKED, so this mostly bounds table-level lock waits;
+    -- contended rows are simply retried on the next run. A timeout fails the
+    -- rule and rolls back its whole pass, but after the first batch the
+    -- table lock is already held, and the quantum bounds what is lost.
+    saved_lock_timeout := pg_catalog.current_setting('lock_timeout');
+    saved_replication_role := pg_catalog.current_setting('session_replication_role');
+    IF ttl_lock_timeout <> '0' THEN
+        PERFORM pg_catalog.set_config('lock_timeout', ttl_lock_timeout, true);
+    END IF;
+
+    -- Activate rules whose concurrently built indexes are now valid. Rows
+    -- another runner is already activating are skipped rather than waited on.
+    UPDATE ttl_index_table t
+    SET active = true,
+        pending_index_ddl = NULL,
+        updated_at = NOW()
+    WHERE t.ctid = ANY(ARRAY(
+              SELECT p.ctid
+              FROM ttl_index_table p
+              WHERE p.pending_index_ddl IS NOT NULL
+              FOR UPDATE SKIP LOCKED
+          ))
+      AND NOT EXISTS (
+          SELECT 1
+          FROM pg_catalog.unnest(ARRAY[t.index_name, t.purge_index_name]) AS wanted(relname)
+          WHERE wanted.relname IS NOT NULL
+            AND NOT EXISTS (
+                SELECT 1
+                FROM pg_catalog.pg_index i
+                JOIN pg_catalog.pg_class idx
+                  ON idx.oid = i.indexrelid
+                JOIN pg_catalog.pg_namespace n
+                  ON n.oid = idx.relnamespace
+                WHERE n.nspname = t.schema_name
+                  AND idx.relname = wanted.relname
+                  AND i.indisvalid
+            )
+      );
+
+    -- Process each table with its own error handling
+    IF profiling THEN
+        PERFORM ttl_profile_phase('rule_lookup');
+    END IF;
+    FOR rec IN SELECT t.schema_name, t.table_name, t.column_name, t.expire_after_seconds, t.batch_size,
+                      t.soft_delete_column, t.archive_to_file, t.archive_table,
+                      t.soft_delete_grace_seconds, t.priority, t.ttl_column_type, t.row_filter,
+                      t.deferred_since,
+                      t.group_column, t.retention_table, t.retention_column, t.resume_group,
+                      t.cascade_children,
+                      t.disable_triggers, t.replication_origin, t.is_expression, c.oid AS relid,
+                      CASE WHEN t.is_expression THEN '(' || t.column_name || ')'
+                           ELSE pg_catalog.quote_ident(t.column_name) END AS ttl_sql,
+                      COALESCE(t.maintenance_window, db_window) AS maintenance_window,
+                      CASE WHEN t.maintenance_window IS NOT NULL THEN t.run_only_in_window
+                           ELSE db_window_only AND db_window IS NOT NULL END AS run_only_in_window
+               FROM ttl_index_table t
+               LEFT JOIN pg_catalog.pg_namespace n
+                 ON n.nspname = t.schema_name
+               LEFT JOIN pg_catalog.pg_class c
+                 ON c.relnamespace = n.oid
+                AND c.relname = t.table_name
+               WHERE t.active = true
+                 AND t.quarantined_at IS NULL
+                 AND (t.next_attempt_at IS NULL OR t.next_attempt_at <= start_time)
+               ORDER BY CASE t.priority WHEN 'high' THEN 0 WHEN 'normal' THEN 1 ELSE 2 END,
+                        t.last_run NULLS FIRST, t.schema_name, t.table_name, t.column_name, t.row_filter
+    LOOP
+        IF profiling THEN
+            PERFORM ttl_profile_phase('scheduling');
+        END IF;
+
+        -- Maintenance windows: inside its window a rule runs unthrottled and
+        -- outside the cycle budget, up to its quantum or until the window
+        -- closes; window-only rules are skipped outside it.
+        rule_in_window := false;
+        IF rec.maintenance_window IS NOT NULL THEN
+            SELECT w.in_window, w.next_boundary INTO rule_in_window, window_end
+            FROM ttl_window_state(rec.maintenance_window, pg_catalog.clock_timestamp()) w;
+        END IF;
+
+        IF rec.run_only_in_window AND NOT rule_in_window THEN
+            RAISE DEBUG 'TTL runner: %.%.% is outside its maintenance window, skipping',
+                        rec.schema_name, rec.table_name, rec.column_name;
+            CONTINUE;
+        END IF;
+
+        rule_unthrottled := rec.priority = 'high' OR rule_in_window;
+
+        CONTINUE WHEN NOT rule_unthrottled AND rules_run > 0
+                      AND pg_catalog.clock_timestamp() >= cycle_deadline;
+
+        -- Low-priority rules only use spare capacity.
+        CONTINUE WHEN rec.priority = 'low' AND higher_backlog AND NOT rule_in_window;
+
+        -- Per-table lock: concurrent runners (worker and manual calls)
+        -- split the rule set by table, and all rules on a table are
+        -- processed by one runner at a time, so they never compete for its
+        -- rows. The first key keeps it apart from application advisory
+        -- locks. Held until the run commits.
+        IF rec.relid IS NOT NULL
+           AND NOT pg_catalog.pg_try_advisory_xact_lock(pg_catalog.hashtext('pg_ttl_index'),
+                                                        rec.relid::INTEGER) THEN
+            RAISE DEBUG 'TTL runner: %.%.% is being processed by another runner, skipping',
+                        rec.schema_name, rec.table_name, rec.column_name;
+            CONTINUE;
+        END IF;
+
+        -- A replication origin can be set up in only one session at a time,
+        -- so runners in this database take turns on it. Sessions elsewhere
+        -- are caught by the object_in_use handler below.
+        IF rec.replication_origin IS NOT NULL
+           AND NOT pg_catalog.pg_try_advisory_xact_lock(
+                   pg_catalog.hashtext('pg_ttl_index.replication_origin'),
+                   pg_catalog.hashtext(rec.replication_origin)) THEN
+            RAISE DEBUG 'TTL runner: replication origin % of %.%.% is in use by another runner, skipping',
+                        rec.replication_origin, rec.schema_name, rec.table_name, rec.column_name;
+            CONTINUE;
+        END IF;
+
+        -- Recorded under the rule lock, so no other runner holds the row.
+        IF load_deferred AND NOT rule_unthrottled THEN
+            UPDATE ttl_index_table
+            SET deferred_since = start_time
+            WHERE ttl_index_table.schema_name = rec.schema_name
+              AND ttl_index_table.table_name = rec.table_name
+              AND ttl_index_table.column_name = rec.column_name
+              AND ttl_index_table.row_filter = rec.row_filter
+              AND ttl_index_table.deferred_since IS NULL;
+            CONTINUE;
+        END IF;
+
+        rules_run := rules_run + 1;
+        table_deleted := 0;
+        table_purged := 0;
+        rule_unfinished := false;
+        rule_started := pg_catalog.clock_timestamp();
+        rule_batches := 0;
+        rule_throttle := '0';
+        rule_failed := false;
+        rule_lock_timeout := false;
+        pass_io := CASE WHEN log_min_ms >= 0 THEN ttl_io_usage() END;
+        batch_limit := rec.batch_size::BIGINT
+                       * CASE WHEN rec.deferred_since IS NOT NULL THEN batch_factor ELSE 1 END;
+        rule_deadline := LEAST(CASE WHEN rule_quantum_ms > 0
+                                    THEN pg_catalog.clock_timestamp()
+                                         + pg_catalog.make_interval(secs => rule_quantum_ms / 1000.0)
+                                    ELSE 'infinity' END,
+                               CASE WHEN rule_unthrottled THEN 'infinity'
+                                    ELSE cycle_deadline END,
+                               CASE WHEN rule_in_window
+                                         AND (rec.run_only_in_window OR rec.priority <> 'high')
+                                    THEN window_end
+                                    ELSE 'infinity' END);
+
+        -- Rules with a purge phase give marking half of their time, so a
+        -- marking backlog cannot hold off the purge indefinitely.
+        mark_deadline := CASE WHEN rec.soft_delete_column IS NOT NULL
+                                   AND rec.soft_delete_grace_seconds IS NOT NULL
+                                   AND rule_deadline < 'infinity'
+                              THEN pg_catalog.clock_timestamp()
+                                   + (rule_deadline - pg_catalog.clock_timestamp()) / 2
+                              ELSE rule_deadline END;
+
+        filter_sql := CASE WHEN rec.row_filter = '' THEN '' ELSE ' AND (' || rec.row_filter || ')' END;
+        cascade_sql := CASE WHEN rec.cascade_children AND rec.relid IS NOT NULL
+                            THEN ttl_cascade_ctes(rec.relid) END;
+        capture_plan := explain_rate > 0 AND pg_catalog.random() < explain_rate;
+        rule_plan := NULL;
+        expiry_lag := 0;
+
+        BEGIN
+            -- Trigger-free rules run as a replica session, so ordinary
+            -- triggers do not fire on their batches. The role that created
+            -- the rule was allowed to do this; the one running it must be as
+            -- well, or the rule fails and backs off like any other error.
+            IF rec.disable_triggers THEN
+                PERFORM pg_catalog.set_config('session_replication_role', 'replica', true);
+            END IF;
+
+            -- Tag the rule's changes with its replication origin. Decoding
+            -- filters on the origin of each change, so other rules in this
+            -- transaction stay untagged.
+            IF rec.replication_origin IS NOT NULL THEN
+                PERFORM pg_catalog.pg_replication_origin_session_setup(rec.replication_origin);
+            END IF;
+
+            IF profiling THEN
+                PERFORM ttl_profile_phase('group_scan');
+            END IF;
+
+            -- Rules with a retention map expire each group with its own
+            -- cutoff. Distinct groups are found with a skip scan over the
+            -- (group, TTL column) index, so each group's pass is a tight
+            -- range scan on it. Groups missing from the map, and rows with
+            -- no group at all, use the rule's expire_after_seconds.
+            IF rec.group_column IS NULL THEN
+                group_quals := ARRAY[''];
+                group_seconds := ARRAY[rec.expire_after_seconds::BIGINT];
+            ELSE
+                EXECUTE format(
+                    'WITH RECURSIVE g(v) AS (
+                         (SELECT %1$I FROM %2$I.%3$I WHERE %1$I IS NOT NULL%4$s ORDER BY %1$I LIMIT 1)
+                         UNION ALL
+                         SELECT (SELECT %1$I FROM %2$I.%3$I WHERE %1$I > g.v%4$s ORDER BY %1$I LIMIT 1)
+                         FROM g
+                         WHERE g.v IS NOT NULL
+                     )
+                     SELECT pg_catalog.array_agg(pg_catalog.format(%5$L, %1$L, g.v) ORDER BY g.v),
+                            pg_catalog.array_agg(COALESCE(m.%6$I, %7$s)::BIGINT ORDER BY g.v)
+                     FROM g
+                     LEFT JOIN %8$s m
+                       ON m.%1$I = g.v
+                     WHERE g.v IS NOT NULL',
+                    rec.group_column, rec.schema_name, rec.table_name, filter_sql,
+                    ' AND %I = %L', rec.retention_column, rec.expire_after_seconds, rec.retention_table
+                ) INTO group_quals, group_seconds;
+
+                group_quals := COALESCE(group_quals, '{}')
+                               || pg_catalog.format(' AND %I IS NULL', rec.group_column);
+                group_seconds := COALESCE(group_seconds, '{}') || rec.expire_after_seconds::BIGINT;
+            END IF;
+
+            -- A pass cut short resumes with the group after the one it
+            -- stopped in, so a large group cannot starve the ones after it.
+            group_count := pg_catalog.array_length(group_quals, 1);
+            group_resume := NULL;
+            FOR group_step IN 0 .. group_count - 1 LOOP
+                group_idx := (COALESCE(rec.resume_group, 0) + group_step) % group_count + 1;
+                -- The cutoff is computed once per pass and inlined as a
+                -- literal of the column's own type.
+                cutoff_ts := pg_catalog.clock_timestamp()
+                             - pg_catalog.make_interval(secs => group_seconds[group_idx]);
+                cutoff_sql := ttl_cutoff_literal(rec.ttl_column_type, cutoff_ts);
+                scope_sql := filter_sql || group_quals[group_idx];
+
+                -- Batch deletion loop
+                LOOP
+                    IF profiling THEN
+                        PERFORM ttl_profile_phase('expire');
+                    END IF;
+
+                    IF rec.soft_delete_column IS NULL AND cascade_sql IS NOT NULL THEN
+                        -- Cascade mode: delete the children of the batch
+                        -- with one join per foreign key, then the parents.
+                        -- The RI cascade triggers then find nothing left.
+                        -- Parents with a locked child are skipped like
+                        -- locked parents.
+                        cleanup_query := format(
+                            'WITH ttl_candidates AS (
+                                SELECT ctid, * FROM %I.%I
+                                WHERE %s < %s%s
+                                LIMIT %s
+                                FOR UPDATE SKIP LOCKED
+                            )%s',
+                            rec.schema_name, rec.table_name,
+                            rec.ttl_sql, cutoff_sql, scope_sql, batch_limit,
+                            cascade_sql
+                        );
+
+                        IF rec.archive_table IS NOT NULL THEN
+                            cleanup_query := format(
+                                '%s, d AS (DELETE FROM %I.%I WHERE ctid = ANY(ARRAY(SELECT ctid FROM ttl_parents)) RETURNING *)
+                                 INSERT INTO %s SELECT * FROM d',
+                                cleanup_query, rec.schema_name, rec.table_name, rec.archive_table
+                            );
+                        ELSE
+                            cleanup_query := format(
+                                '%s DELETE FROM %I.%I WHERE ctid = ANY(ARRAY(SELECT ctid FROM ttl_parents))%s',
+                                cleanup_query, rec.schema_name, rec.table_name,
+                                CASE WHEN rec.archive_to_file THEN ' RETURNING *' ELSE '' END
+                            );
+                        END IF;
+                    ELSIF rec.soft_delete_column IS NULL THEN
+                        -- Hard delete mode
+                        cleanup_query := format(
+                            'DELETE FROM %I.%I WHERE ctid = ANY(ARRAY(
+                                SELECT ctid FROM %I.%I
+                                WHERE %s < %s%s
+                                LIMIT %s
+                                FOR UPDATE SKIP LOCKED
+                            ))',
+                            rec.schema_name, rec.table_name,
+                            rec.schema_name, rec.table_name,
+                            rec.ttl_sql, cutoff_sql, scope_sql, batch_limit
+                        );
+
+                        IF rec.archive_to_file THEN
+                            cleanup_query := cleanup_query || ' RETURNING *';
+                        ELSIF rec.archive_table IS NOT NULL THEN
+                            -- Move mode: delete and copy in one statement.
+                            cleanup_query := format(
+                                'WITH d AS (%s RETURNING *) INSERT INTO %s SELECT * FROM d',
+                                cleanup_query, rec.archive_table
+                            );
+                        END IF;
+                    ELSE
+                        -- Soft delete mode: mark rows once.
+                        cleanup_query := format(
+                            'UPDATE %I.%I
+                             SET %I = pg_catalog.clock_timestamp()
+                             WHERE ctid = ANY(ARRAY(
+                                 SELECT ctid FROM %I.%I
+                                 WHERE %s < %s%s
+                                   AND %I IS NULL
+                                 LIMIT %s
+                                 FOR UPDATE SKIP LOCKED
+                             ))',
+                            rec.schema_name, rec.table_name,
+                            rec.soft_delete_column,
+                            rec.schema_name, rec.table_name,
+                            rec.ttl_sql, cutoff_sql, scope_sql,
+                            rec.soft_delete_column, batch_limit
+                        );
+                    END IF;
+
+                    -- Plan capture: the first batch of a sampled pass is run
+                    -- under EXPLAIN ANALYZE in a subtransaction that is then
+                    -- rolled back, and runs again for real below.
+                    IF capture_plan THEN
+                        capture_plan := false;
+                        IF profiling THEN
+                            PERFORM ttl_profile_phase('explain');
+                        END IF;
+                        BEGIN
+                            EXECUTE 'EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ' || cleanup_query
+                            INTO rule_plan;
+                            RAISE SQLSTATE 'TTL00';
+                        EXCEPTION
+                            WHEN SQLSTATE 'TTL00' THEN
+                                NULL;
+                            WHEN OTHERS THEN
+                                RAISE DEBUG 'TTL runner: plan capture for %.%.% failed: %',
+                                            rec.schema_name, rec.table_name, rec.column_name, SQLERRM;
+                        END;
+                        IF profiling THEN
+                            PERFORM ttl_profile_phase('expire');
+                        END IF;
+                    END IF;
+
+                    IF log_min_ms >= 0 THEN
+                        batch_started := pg_catalog.clock_timestamp();
+                        batch_io := ttl_io_usage();
+                    END IF;
+
+                    IF rec.archive_to_file THEN
+                        -- Archive mode: rows are written to disk by the C helper
+                        -- in the same statement that deletes them. Files are
+                        -- per rule: expressions and row filters are named by
+                        -- a hash, since their text does not fit a file name.
+                        batch_deleted := ttl_archive_batch(cleanup_query,
+                            rec.schema_name || '.' || rec.table_name || '.'
+                            || CASE WHEN rec.is_expression THEN 'expr' ELSE rec.column_name END
+                            || CASE WHEN rec.is_expression OR rec.row_filter <> ''
+                                    THEN '.' || pg_catalog.to_hex(pg_catalog.hashtext(rec.column_name || E'\n' || rec.row_filter))
+                                    ELSE '' END);
+                    ELSE
+                        EXECUTE cleanup_query;
+                        GET DIAGNOSTICS batch_deleted = ROW_COUNT;
+                    END IF;
+
+                    IF log_min_ms >= 0 THEN
+                        batch_ms := EXTRACT(EPOCH FROM pg_catalog.clock_timestamp() - batch_started) * 1000;
+                        IF batch_ms >= log_min_ms THEN
+                            RAISE LOG '%', ttl_slow_log_entry('batch', rec.schema_name, rec.table_name,
+                                                              rec.column_name, rec.row_filter, batch_deleted,
+                                                              batch_ms, batch_io, ttl_io_usage(), 0);
+                        END IF;
+                    END IF;
+
+                    table_deleted := table_deleted + batch_deleted;
+                    rule_batches := rule_batches + 1;
+                    total_deleted := total_deleted + batch_deleted;
+
+                    -- Exit loop when no more rows to delete
+                    EXIT WHEN batch_deleted = 0;
+
+                    -- Yield to other processes between batches. The quantum
+                    -- is checked after the pause, so a batch never starts
+                    -- once it is used up.
+                    IF NOT rule_unthrottled AND pg_catalog.clock_timestamp() < mark_deadline THEN
+                        IF profiling THEN
+                            PERFORM ttl_profile_phase('sleep');
+                        END IF;
+                        sleep_started := pg_catalog.clock_timestamp();
+                        PERFORM pg_catalog.pg_sleep(0.01);
+                        rule_throttle := rule_throttle + (pg_catalog.clock_timestamp() - sleep_started);
+                    END IF;
+
+                    IF pg_catalog.clock_timestamp() >= mark_deadline THEN
+                        rule_unfinished := true;
+                        EXIT;
+                    END IF;
+                END LOOP;
+
+                IF profiling THEN
+                    PERFORM ttl_profile_phase('lag_probe');
+                END IF;
+
+                -- Expiry lag: probe the oldest remaining TTL value. min() is
+                -- answered from one end of the TTL index (the partial index
+                -- for soft delete rules, whose marked rows no longer count).
+                EXECUTE format(
+                    'SELECT %s FROM %I.%I%s',
+                    format(CASE rec.ttl_column_type
+                               WHEN 'epoch_s' THEN 'pg_catalog.to_timestamp(pg_catalog.min(%s))'
+                               WHEN 'epoch_ms' THEN 'pg_catalog.to_timestamp(pg_catalog.min(%s) / 1000.0)'
+                               WHEN 'epoch_us' THEN 'pg_catalog.to_timestamp(pg_catalog.min(%s) / 1000000.0)'
+                               WHEN 'date' THEN '(pg_catalog.min(%s) + 1)::TIMESTAMPTZ'
+                               ELSE 'pg_catalog.min(%s)::TIMESTAMPTZ'
+                           END, rec.ttl_sql),
+                    rec.schema_name, rec.table_name,
+                    CASE WHEN rec.soft_delete_column IS NULL THEN ' WHERE true'
+                         ELSE format(' WHERE %I IS NULL', rec.soft_delete_column) END || scope_sql
+                ) INTO oldest_value;
+
+                -- GREATEST ignores NULL, so an empty group reports no lag.
+                expiry_lag := GREATEST(expiry_lag, pg_catalog.floor(EXTRACT(EPOCH FROM
+                                  pg_catalog.clock_timestamp()
+                                  - pg_catalog.make_interval(secs => group_seconds[group_idx])
+                                  - oldest_value)))::BIGINT;
+
+                IF rule_unfinished THEN
+                    group_resume := CASE WHEN rec.group_column IS NOT NULL THEN group_idx % group_count END;
+                    EXIT;
+                END IF;
+            END LOOP;
+
+            -- Soft delete purge: hard-delete rows whose grace period has
+            -- passed. Marked rows are outside the partial TTL index, so this
+            -- scan is driven by the soft delete column's purge index. It
+            -- runs even when marking was cut short, with the rest of the
+            -- rule's time.
+            IF rec.soft_delete_column IS NOT NULL AND rec.soft_delete_grace_seconds IS NOT NULL THEN
+                cleanup_query := format(
+                    'DELETE FROM %I.%I WHERE ctid = ANY(ARRAY(
+                        SELECT ctid FROM %I.%I
+                        WHERE %s < %s%s
+                          AND %I < %L::TIMESTAMPTZ
+                        LIMIT %s
+                        FOR UPDATE SKIP LOCKED
+                    ))',
+                    rec.schema_name, rec.table_name,
+                    rec.schema_name, rec.table_name,
+                    rec.ttl_sql, cutoff_sql, filter_sql,
+                    rec.soft_delete_column,
+                    pg_catalog.clock_timestamp() - pg_catalog.make_interval(secs => rec.soft_delete_grace_seconds),
+                    batch_limit
+                );
+
+                LOOP
+                    IF profiling THEN
+                        PERFORM ttl_profile_phase('purge');
+                    END IF;
+
+                    IF log_min_ms >= 0 THEN
+                        batch_started := pg_catalog.clock_timestamp();
+                        batch_io := ttl_io_usage();
+                    END IF;
+
+                    EXECUTE cleanup_query;
+                    GET DIAGNOSTICS batch_deleted = ROW_COUNT;
+
+                    IF log_min_ms >= 0 THEN
+                        batch_ms := EXTRACT(EPOCH FROM pg_catalog.clock_timestamp() - batch_started) * 1000;
+                        IF batch_ms >= log_min_ms THEN
+                            RAISE LOG '%', ttl_slow_log_entry('purge_batch', rec.schema_name, rec.table_name,
+                                                              rec.column_name, rec.row_filter, batch_deleted,
+                                                              batch_ms, batch_io, ttl_io_usage(), 0);
+                        END IF;
+                    END IF;
+
+                    table_purged := table_purged + batch_deleted;
+                    rule_batches := rule_batches + 1;
+                    total_deleted := total_deleted + batch_deleted;
+
+                    EXIT WHEN batch_deleted = 0;
+
+                    IF NOT rule_unthrottled AND pg_catalog.clock_timestamp() < rule_deadline THEN
+                        IF profiling THEN
+                            PERFORM ttl_profile_phase('sleep');
+                        END IF;
+                        sleep_started := pg_catalog.clock_timestamp();
+                        PERFORM pg_catalog.pg_sleep(0.01);
+                        rule_throttle := rule_throttle + (pg_catalog.clock_timestamp() - sleep_started);
+                    END IF;
+
+                    IF pg_catalog.clock_timestamp() >= rule_deadline THEN
+                        rule_unfinished := true;
+                        EXIT;
+                    END IF;
+                END LOOP;
+            END IF;
+
+            -- The origin session is not rolled back with the subtransaction,
+            -- so it is reset as soon as the rule's deletes are done, and on
+            -- error, to keep the bookkeeping below untagged.
+            IF rec.replication_origin IS NOT NULL
+               AND pg_catalog.pg_replication_origin_session_is_setup() THEN
+                PERFORM pg_catalog.pg_replication_origin_session_reset();
+            END IF;
+
+            IF profiling THEN
+                PERFORM ttl_profile_phase('stats_update');
+            END IF;
+
+            IF lag_warning_seconds > 0 AND expiry_lag > lag_warning_seconds THEN
+                RAISE WARNING 'TTL runner: %.%.% is % seconds behind its expiry cutoff',
+                              rec.schema_name, rec.table_name, rec.column_name, expiry_lag;
+            END IF;
+
+            pass_ms := EXTRACT(EPOCH FROM pg_catalog.clock_timestamp() - rule_started) * 1000;
+
+            -- Update stats for this table
+            UPDATE ttl_index_table
+            SET last_run = start_time,
+                expiry_lag_seconds = expiry_lag,
+                rows_deleted_last_run = table_deleted,
+                total_rows_deleted = ttl_index_table.total_rows_deleted + table_deleted,
+                total_rows_purged = ttl_index_table.total_rows_purged + table_purged,
+                last_plan = COALESCE(rule_plan, ttl_index_table.last_plan),
+                last_plan_at = CASE WHEN rule_plan IS NOT NULL THEN start_time
+                                    ELSE ttl_index_table.last_plan_at END,
+                total_batches = ttl_index_table.total_batches + rule_batches,
+                last_pass_seconds = pass_ms / 1000,
+                total_pass_seconds = ttl_index_table.total_pass_seconds + pass_ms / 1000,
+                total_throttle_seconds = ttl_index_table.total_throttle_seconds
+                                         + EXTRACT(EPOCH FROM rule_throttle),
+                deferred_since = CASE WHEN rule_unfinished THEN ttl_index_table.deferred_since END,
+                resume_group = group_resume,
+                consecutive_failures = 0,
+                next_attempt_at = NULL
+            WHERE ttl_index_table.schema_name = rec.schema_name
+              AND ttl_index_table.table_name = rec.table_name
+              AND ttl_index_table.column_name = rec.column_name
+              AND ttl_index_table.row_filter = rec.row_filter;
+
+            -- Slow log: one JSON line per pass at or above
+            -- pg_ttl_index.log_min_duration, for log pipelines.
+            IF log_min_ms >= 0 AND pass_ms >= log_min_ms THEN
+                RAISE LOG '%', ttl_slow_log_entry('pass', rec.schema_name, rec.table_name,
+                                                  rec.column_name, rec.row_filter,
+                                                  table_deleted + table_purged, pass_ms,
+                                                  pass_io, ttl_io_usage(),
+                                                  EXTRACT(EPOCH FROM rule_throttle) * 1000);
+            END IF;
+
+        EXCEPTION
+            WHEN lock_not_available THEN
+                IF rec.replication_origin IS NOT NULL
+                   AND pg_catalog.pg_replication_origin_session_is_setup() THEN
+                    PERFORM pg_catalog.pg_replication_origin_session_reset();
+                END IF;
+                rule_lock_timeout := true;
+                RAISE NOTICE 'TTL runner: Lock timeout on %.%.%, retrying later',
+                             rec.schema_name, rec.table_name, rec.column_name;
+            WHEN object_in_use THEN
+                IF rec.replication_origin IS NOT NULL
+                   AND pg_catalog.pg_replication_origin_session_is_setup() THEN
+                    PERFORM pg_catalog.pg_replication_origin_session_reset();
+                END IF;
+                rule_failed := true;
+                rule_error := SQLERRM;
+                rule_error_state := SQLSTATE;
+                RAISE NOTICE 'TTL runner: %.%.% is busy in another session (%), retrying later',
+                             rec.schema_name, rec.table_name, rec.column_name, SQLERRM;
+            WHEN OTHERS THEN
+                IF rec.replication_origin IS NOT NULL
+                   AND pg_catalog.pg_replication_origin_session_is_setup() THEN
+                    PERFORM pg_catalog.pg_replication_origin_session_reset();
+                END IF;
+                rule_failed := true;
+                rule_error := SQLERRM;
+                rule_error_state := SQLSTATE;
+                -- Log error but continue with other tables
+                RAISE WARNING 'TTL runner: Failed to cleanup table %.%.%: % (%)',
+                             rec.schema_name, rec.table_name, rec.column_name, SQLERRM, SQLSTATE;
+        END;
+
+        -- The rule's own stats update was rolled back with it. A failing
+        -- rule is retried after an exponential backoff, so a broken rule
+        -- does not cost a scan and a warning on every run, and is
+        -- quarantined after max_consecutive_failures. Objects in use
+        -- elsewhere, such as the rule's replication origin, back off too but
+        -- never quarantine: the rule itself is fine.
+        IF rule_failed THEN
+            UPDATE ttl_index_table
+            SET total_errors = ttl_index_table.total_errors + 1,
+                consecutive_failures = ttl_index_table.consecutive_failures + 1,
+                last_error = pg_catalog.format('%s (%s)', rule_error, rule_error_state),
+                last_error_at = pg_catalog.clock_timestamp(),
+                next_attempt_at = pg_catalog.clock_timestamp()
+                                  + pg_catalog.make_interval(secs => LEAST(
+                                        backoff_s * 2 ^ LEAST(ttl_index_table.consecutive_failures, 20),
+                                        86400)),
+                quarantined_at = CASE WHEN max_failures > 0
+                                           AND ttl_index_table.consecutive_failures + 1 >= max_failures
+                                           AND rule_error_state <> '55006'
+                                      THEN pg_catalog.clock_timestamp() END
+            WHERE ttl_index_table.schema_name = rec.schema_name
+              AND ttl_index_table.table_name = rec.table_name
+              AND ttl_index_table.column_name = rec.column_name
+              AND ttl_index_table.row_filter = rec.row_filter
+            RETURNING consecutive_failures, quarantined_at IS NOT NULL
+            INTO rule_failures, rule_quarantined;
+
+            IF rule_quarantined THEN
+                RAISE WARNING 'TTL runner: %.%.% quarantined after % consecutive failures',
+                              rec.schema_name, rec.table_name, rec.column_name, rule_failures
+                      USING HINT = 'Fix the cause, then call ttl_release_rule().';
+            END IF;
+        END IF;
+
+        -- A lock timeout is contention, not an error: the rule is deferred
+        -- like under load and retried on the next run, with catch-up batches
+        -- once load allows.
+        IF rule_lock_timeout THEN
+            UPDATE ttl_index_table
+            SET deferred_since = start_time
+            WHERE ttl_index_table.schema_name = rec.schema_name
+              AND ttl_index_table.table_name = rec.table_name
+              AND ttl_index_table.column_name = rec.column_name
+              AND ttl_index_table.row_filter = rec.row_filter
+              AND ttl_index_table.deferred_since IS NULL;
+        END IF;
+
+        IF rec.disable_triggers THEN
+            PERFORM pg_catalog.set_config('session_replication_role', saved_replication_role, true);
+        END IF;
+
+        IF rule_unfinished AND rec.priority <> 'low' THEN
+            higher_backlog := true;
+        END IF;
+    END LOOP;
+
+    IF profiling THEN
+        PERFORM ttl_profile_phase(NULL);
+    END IF;
+
+    -- Keep this run's profile. Rows a concurrent runner still holds are
+    -- left for the next run to remove.
+    IF profiling THEN
+        DELETE FROM ttl_run_profile
+        WHERE ctid = ANY(ARRAY(SELECT ctid FROM ttl_run_profile FOR UPDATE SKIP LOCKED));
+
+        INSERT INTO ttl_run_profile (run_at, phase, calls, wall_ms, cpu_ms)
+        SELECT start_time, p.phase, p.calls, p.wall_ms, p.cpu_ms
+        FROM ttl_profile_collect() p;
+    END IF;
+
+    PERFORM pg_catalog.set_config('lock_timeout', saved_lock_timeout, true);
+
+    RETURN total_deleted;
+END;
+$$;
+
+-- Statements the background worker runs, outside a transaction block, to
+-- build indexes queued by ttl_create_index(..., p_concurrently => true).
+-- Invalid leftovers of a failed concurrent build are dropped first, since
+-- CREATE INDEX ... IF NOT EXISTS would otherwise skip them forever.
+CREATE FUNCTION ttl_pending_index_ddl()
+RETURNS SETOF TEXT
+LANGUAGE sql
+SET search_path FROM CURRENT
+AS $$
+    SELECT ddl
+    FROM (
+        SELECT t.schema_name, t.table_name, t.column_name, 0 AS step,
+               pg_catalog.format('DROP INDEX CONCURRENTLY IF EXISTS %I.%I',
+                                 n.nspname, idx.relname) AS ddl
+        FROM ttl_index_table t
+        JOIN pg_catalog.pg_namespace n
+          ON n.nspname = t.schema_name
+        JOIN pg_catalog.pg_class idx
+          ON idx.relnamespace = n.oid
+         AND idx.relname IN (t.index_name, t.purge_index_name)
+        JOIN pg_catalog.pg_index i
+          ON i.indexrelid = idx.oid
+        WHERE t.pending_index_ddl IS NOT NULL
+          AND NOT i.indisvalid
+        UNION ALL
+        SELECT t.schema_name, t.table_name, t.column_name, 1 AS step, d.ddl
+        FROM ttl_index_table t,
+             pg_catalog.unnest(t.pending_index_ddl) AS d(ddl)
+        WHERE t.pending_index_ddl IS NOT NULL
+    ) s
+    ORDER BY s.schema_name, s.table_name, s.column_name, s.step;
+$$;
+
+-- Archive helper used by ttl_runner(): executes a DELETE ... RETURNING batch
+-- and appends the rows to a compressed COPY-format file named after the
+-- database and p_file_prefix.
+CREATE FUNCTION ttl_archive_batch(p_query TEXT, p_file_prefix TEXT) RETURNS BIGINT
+LANGUAGE C STRICT
+SET search_path FROM CURRENT
+AS 'MODULE_PATHNAME';
+
+REVOKE ALL ON FUNCTION ttl_archive_batch(TEXT, TEXT) FROM PUBLIC;
+
+-- Profiling helpers used by ttl_runner(): per-phase wall and CPU time,
+-- accumulated in the calling backend
+CREATE FUNCTION ttl_profile_reset() RETURNS VOID
+LANGUAGE C
+AS 'MODULE_PATHNAME';
+
+-- Not STRICT: a NULL phase ends the current one
+CREATE FUNCTION ttl_profile_phase(p_phase TEXT) RETURNS VOID
+LANGUAGE C
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION ttl_profile_collect()
+RETURNS TABLE (
+    phase TEXT,
+    calls BIGINT,
+    wall_ms DOUBLE PRECISION,
+    cpu_ms DOUBLE PRECISION
+)
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME';
+
+-- Per-backend I/O counters used by ttl_runner()'s slow log:
+-- {shared_blks_hit, shared_blks_read, shared_blks_dirtied, wal_bytes}
+CREATE FUNCTION ttl_io_usage() RETURNS BIGINT[]
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME';
+
+-- One pg_ttl_index.log_min_duration entry: the rule, the rows and time
+-- spent, and the I/O between two ttl_io_usage() snapshots
+CREATE FUNCTION ttl_slow_log_entry(
+    p_event TEXT,
+    p_schema TEXT,
+    p_table TEXT,
+    p_column TEXT,
+    p_filter TEXT,
+    p_rows BIGINT,
+    p_duration_ms DOUBLE PRECISION,
+    p_io_start BIGINT[],
+    p_io_end BIGINT[],
+    p_throttle_ms DOUBLE PRECISION
+)
+RETURNS JSON
+LANGUAGE sql
+IMMUTABLE
+AS $$
+    SELECT pg_catalog.json_build_object(
+        'event', p_event,
+        'relation', pg_catalog.format('%I.%I', p_schema, p_table),
+        'column', p_column,
+        'filter', NULLIF(p_filter, ''),
+        'rows', p_rows,
+        'duration_ms', pg_catalog.round(p_duration_ms::NUMERIC, 3),
+        'wal_bytes', p_io_end[4] - p_io_start[4],
+        'shared_blks_hit', p_io_end[1] - p_io_start[1],
+        'shared_blks_read', p_io_end[2] - p_io_start[2],
+        'shared_blks_dirtied', p_io_end[3] - p_io_start[3],
+        'throttle_ms', pg_catalog.round(p_throttle_ms::NUMERIC, 3)
+    );
+$$;
+
+-- Where the time of the last profiled ttl_runner() call went, by phase
+CREATE FUNCTION ttl_last_run_profile()
+RETURNS TABLE (
+    phase TEXT,
+    calls BIGINT,
+    wall_ms DOUBLE PRECISION,
+    cpu_ms DOUBLE PRECISION
+)
+LANGUAGE sql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+    SELECT p.phase, p.calls, p.wall_ms, p.cpu_ms
+    FROM ttl_run_profile p
+    WHERE p.run_at = (SELECT pg_catalog.max(r.run_at) FROM ttl_run_profile r)
+    ORDER BY p.wall_ms DESC, p.phase;
+$$;
+
+-- Escapes a label value for the OpenMetrics text format
+CREATE FUNCTION ttl_metric_label(p_value TEXT)
+RETURNS TEXT
+LANGUAGE sql
+IMMUTABLE
+AS $$
+    SELECT pg_catalog.replace(pg_catalog.replace(pg_catalog.replace(
+               p_value, E'\\', E'\\\\'), '"', E'\\"'), E'\n', E'\\n');
+$$;
+
+-- Per-rule counters and gauges and the worker state in the OpenMetrics text
+-- format, for a scraper such as postgres_exporter. Built from the rule
+-- table only; user tables are not touched.
+CREATE FUNCTION ttl_metrics()
+RETURNS TEXT
+LANGUAGE sql
+STABLE
+SET search_path FROM CURRENT
+AS $$
+    WITH families (ord, name, kind, help) AS (
+        VALUES (1, 'pg_ttl_index_rows_deleted', 'counter', 'Rows expired by the rule.'),
+               (2, 'pg_ttl_index_rows_purged', 'counter', 'Soft-deleted rows purged by the rule.'),
+               (3, 'pg_ttl_index_batches', 'counter', 'Cleanup batches executed.'),
+               (4, 'pg_ttl_index_errors', 'counter', 'Passes that failed.'),
+               (5, 'pg_ttl_index_pass_seconds', 'counter', 'Time spent in passes over the rule.'),
+               (6, 'pg_ttl_index_throttle_seconds', 'counter', 'Time spent sleeping between batches.'),
+               (7, 'pg_ttl_index_last_pass_seconds', 'gauge', 'Duration of the last pass.'),
+               (8, 'pg_ttl_index_expiry_lag_seconds', 'gauge', 'How far the oldest remaining row is past its cutoff.'),
+               (9, 'pg_ttl_index_active', 'gauge', 'Whether the rule is active.'),
+               (10, 'pg_ttl_index_quarantined', 'gauge', 'Whether the rule is quarantined after repeated failures.'),
+               (11, 'pg_ttl_index_worker_up', 'gauge', 'Whether the TTL worker of this database is running.'),
+               (12, 'pg_ttl_index_worker_busy', 'gauge', 'Whether the TTL worker is in a cleanup run.')
+    ),
+    samples (ord, labels, value) AS (
+        SELECT v.ord,
+               pg_catalog.format('{schema="%s",table="%s",column="%s",filter="%s"}',
+                                 ttl_metric_label(t.schema_name), ttl_metric_label(t.table_name),
+                                 ttl_metric_label(t.column_name), ttl_metric_label(t.row_filter)),
+               v.value
+        FROM ttl_index_table t
+        CROSS JOIN LATERAL (
+            VALUES (1, t.total_rows_deleted::DOUBLE PRECISION),
+                   (2, t.total_rows_purged::DOUBLE PRECISION),
+                   (3, t.total_batches::DOUBLE PRECISION),
+                   (4, t.total_errors::DOUBLE PRECISION),
+                   (5, t.total_pass_seconds),
+                   (6, t.total_throttle_seconds),
+                   (7, t.last_pass_seconds),
+                   (8, t.expiry_lag_seconds::DOUBLE PRECISION),
+                   (9, CASE WHEN t.active THEN 1 ELSE 0 END::DOUBLE PRECISION),
+                   (10, CASE WHEN t.quarantined_at IS NOT NULL THEN 1 ELSE 0 END::DOUBLE PRECISION)
+        ) AS v (ord, value)
+        WHERE v.value IS NOT NULL
+        UNION ALL
+        SELECT 11, '', pg_catalog.count(*)::DOUBLE PRECISION
+        FROM pg_catalog.pg_stat_activity a
+        WHERE a.application_name LIKE 'TTL Worker DB %'
+          AND a.datname = pg_catalog.current_database()
+        UNION ALL
+        SELECT 12, '', pg_catalog.count(*)::DOUBLE PRECISION
+        FROM pg_catalog.pg_stat_activity a
+        WHERE a.application_name LIKE 'TTL Worker DB %'
+          AND a.datname = pg_catalog.current_database()
+          AND a.state = 'active'
+    )
+    SELECT COALESCE(pg_catalog.string_agg(m.family, '' ORDER BY m.ord), '') || E'# EOF\n'
+    FROM (
+        SELECT f.ord,
+               pg_catalog.format(E'# TYPE %s %s\n# HELP %s %s\n', f.name, f.kind, f.name, f.help)
+               || pg_catalog.string_agg(pg_catalog.format(E'%s%s%s %s\n', f.name,
+                                                          CASE WHEN f.kind = 'counter' THEN '_total' ELSE '' END,
+                                                          s.labels, s.value),
+                                        '' ORDER BY s.labels) AS family
+        FROM families f
+        JOIN samples s
+          ON s.ord = f.ord
+        GROUP BY f.ord, f.name, f.kind, f.help
+    ) m;
+$$;
+
+-- Enhanced summary with stats
+CREATE OR REPLACE FUNCTION ttl_summary()
+RETURNS TABLE(
+    schema_name TEXT,
+    table_name TEXT,
+    column_name TEXT,
+    expire_after_seconds INTEGER,
+    batch_size INTEGER,
+    active BOOLEAN,
+    last_run TIMESTAMPTZ,
+    time_since_last_run INTERVAL,
+    rows_deleted_last_run BIGINT,
+    total_rows_deleted BIGINT,
+    index_name TEXT,
+    soft_delete_column TEXT,
+    cleanup_mode TEXT,
+    archive_table TEXT,
+    soft_delete_grace_seconds INTEGER,
+    total_rows_purged BIGINT,
+    index_pending BOOLEAN,
+    priority TEXT,
+    expiry_lag_seconds BIGINT,
+    maintenance_window TEXT,
+    run_only_in_window BOOLEAN,
+    row_filter TEXT,
+    group_column TEXT,
+    retention_table TEXT,
+    cascade_children BOOLEAN,
+    disable_triggers BOOLEAN,
+    replication_origin TEXT,
+    consecutive_failures INTEGER,
+    next_attempt_at TIMESTAMPTZ,
+    quarantined BOOLEAN,
+    last_error TEXT
+)
+LANGUAGE sql
+SET search_path FROM CURRENT
+AS $$
+    SELECT
+        t.schema_name,
+        t.table_name,
+        t.column_name,
+        t.expire_after_seconds,
+        t.batch_size,
+        t.active,
+        t.last_run,
+        CASE
+            WHEN t.last_run IS NOT NULL THEN NOW() - t.last_run
+            ELSE NULL
+        END as time_since_last_run,
+        t.rows_deleted_last_run,
+        t.total_rows_deleted,
+        t.index_name,
+        t.soft_delete_column,
+        CASE
+            WHEN t.soft_delete_column IS NOT NULL THEN 'soft_delete'
+            WHEN t.archive_to_file THEN 'archive_file'
+            WHEN t.archive_table IS NOT NULL THEN 'archive_table'
+            ELSE 'hard_delete'
+        END AS cleanup_mode,
+        t.archive_table,
+        t.soft_delete_grace_seconds,
+        t.total_rows_purged,
+        t.pending_index_ddl IS NOT NULL AS index_pending,
+        t.priority,
+        t.expiry_lag_seconds,
+        t.maintenance_window,
+        t.run_only_in_window,
+        t.row_filter,
+        t.group_column,
+        t.retention_table,
+        t.cascade_children,
+        t.disable_triggers,
+        t.replication_origin,
+        t.consecutive_failures,
+        t.next_attempt_at,
+        t.quarantined_at IS NOT NULL AS quarantined,
+        t.last_error
+    FROM ttl_index_table t
+    ORDER BY t.schema_name, t.table_name, t.column_name, t.row_filter;
+$$;
@@ -0,0 +1,468 @@
+#include "postgres.h"
+
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "pg_ttl_index.h"
+
+#ifdef HAVE_LIBZ
+#define TTL_ARCHIVE_SUFFIX ".copy.gz"
+#else
+#define TTL_ARCHIVE_SUFFIX ".copy"
+#endif
+
+#define TTL_ARCHIVE_MAX_SEGMENTS 10000
+#define TTL_ARCHIVE_WRITE_BUFFER_SIZE (128 * 1024)
+#define TTL_ARCHIVE_LOCK_RETRY_USEC 10000L
+#define TTL_ARCHIVE_FETCH_ROWS 1000
+
+/* An archive file open for appending, locked by this backend */
+typedef struct ArchiveFile {
+    char path[MAXPGPATH];
+    int fd;
+    bool created;
+#ifdef HAVE_LIBZ
+    gzFile gz;
+#endif
+} ArchiveFile;
+
+PG_FUNCTION_INFO_V1(ttl_archive_batch);
+
+/* Static function declarations */
+static void append_copy_value(StringInfo buf, const char *value);
+static void format_copy_rows(StringInfo buf, SPITupleTable *tuptable,
+                             uint64 rows);
+static char *sanitize_file_prefix(const char *prefix);
+static void check_archive_directory(void);
+static void lock_archive_file(int fd, const char *path);
+static int open_archive_file(char *path, const char *prefix, bool *created);
+static void begin_archive_write(ArchiveFile *file, const char *prefix);
+static void append_archive_rows(ArchiveFile *file, StringInfo buf);
+static void abort_archive_write(ArchiveFile *file);
+static void finish_archive_write(ArchiveFile *file);
+static void fsync_archive_directory(void);
+
+/*
+ * Executes a DELETE ... RETURNING batch and appends the returned rows to the
+ * current archive file in COPY text format.  The file is fsynced before we
+ * return, so the rows are durable on disk before the deleting transaction can
+ * commit.  Returns the number of rows archived (and deleted).
+ *
+ * The batch runs through a cursor and is written TTL_ARCHIVE_FETCH_ROWS rows
+ * at a time, so memory use does not grow with the batch size: the executor
+ * keeps the RETURNING rows in a tuplestore, which spills to disk beyond
+ * work_mem.
+ *
+ * Delivery is at-least-once: the file is written outside the transaction, so
+ * if the pass or the run aborts after this batch, its rows stay in the table
+ * and are archived again by a later run.
+ */
+Datum ttl_archive_batch(PG_FUNCTION_ARGS)
+{
+    char *query = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    char *prefix = text_to_cstring(PG_GETARG_TEXT_PP(1));
+    ArchiveFile file;
+    StringInfoData buf;
+    SPIPlanPtr plan;
+    Portal portal;
+    uint64 rows = 0;
+    volatile bool file_open = false;
+
+    if (ttl_archive_directory == NULL || ttl_archive_directory[0] == '\0')
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("pg_ttl_index.archive_directory is not set")));
+
+    check_archive_directory();
+
+    if (SPI_connect() != SPI_OK_CONNECT)
+        ereport(ERROR, (errmsg("SPI_connect failed")));
+
+    plan = SPI_prepare(query, 0, NULL);
+    if (plan == NULL || !SPI_is_cursor_plan(plan))
+        ereport(ERROR,
+                (errmsg("TTL archive: batch query did not return rows")));
+
+    /* The first fetch runs the whole DELETE; later ones read its results. */
+    portal = SPI_cursor_open(NULL, plan, NULL, NULL, false);
+    initStringInfo(&buf);
+
+    PG_TRY();
+    {
+        for (;;) {
+            SPI_cursor_fetch(portal, true, TTL_ARCHIVE_FETCH_ROWS);
+            if (SPI_processed == 0)
+                break;
+
+            if (!file_open) {
+                begin_archive_write(&file, prefix);
+                file_open = true;
+            }
+
+            resetStringInfo(&buf);
+            format_copy_rows(&buf, SPI_tuptable, SPI_processed);
+            append_archive_rows(&file, &buf);
+
+            rows += SPI_processed;
+            SPI_freetuptable(SPI_tuptable);
+        }
+    }
+    PG_CATCH();
+    {
+        if (file_open)
+            abort_archive_write(&file);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    if (file_open) {
+        finish_archive_write(&file);
+        if (file.created)
+            fsync_archive_directory();
+    }
+
+    pfree(buf.data);
+    SPI_cursor_close(portal);
+    SPI_finish();
+
+    PG_RETURN_INT64((int64)rows);
+}
+
+/* Appends one attribute value using COPY text format escaping. */
+static void append_copy_value(StringInfo buf, const char *value)
+{
+    const char *p;
+
+    for (p = value; *p != '\0'; p++) {
+        switch (*p) {
+        case '\\':
+            appendStringInfoString(buf, "\\\\");
+            break;
+        case '\b':
+            appendStringInfoString(buf, "\\b");
+            break;
+        case '\f':
+            appendStringInfoString(buf, "\\f");
+            break;
+        case '\n':
+            appendStringInfoString(buf, "\\n");
+            break;
+        case '\r':
+            appendStringInfoString(buf, "\\r");
+            break;
+        case '\t':
+            appendStringInfoString(buf, "\\t");
+            break;
+        case '\v':
+            appendStringInfoString(buf, "\\v");
+            break;
+        default:
+            appendStringInfoChar(buf, *p);
+            break;
+        }
+    }
+}
+
+/* Formats SPI result rows as COPY text lines. */
+static void format_copy_rows(StringInfo buf, SPITupleTable *tuptable,
+                             uint64 rows)
+{
+    TupleDesc tupdesc = tuptable->tupdesc;
+    uint64 row;
+    int col;
+
+    for (row = 0; row < rows; row++) {
+        HeapTuple tuple = tuptable->vals[row];
+
+        for (col = 1; col <= tupdesc->natts; col++) {
+            char *value = SPI_getvalue(tuple, tupdesc, col);
+
+            if (col > 1)
+                appendStringInfoChar(buf, '\t');
+
+            if (value == NULL) {
+                appendStringInfoString(buf, "\\N");
+            } else {
+                append_copy_value(buf, value);
+                pfree(value);
+            }
+        }
+
+        appendStringInfoChar(buf, '\n');
+    }
+}
+
+/* Keeps relation names from escaping the archive directory. */
+static char *sanitize_file_prefix(const char *prefix)
+{
+    char *result = pstrdup(prefix);
+    char *p;
+
+    for (p = result; *p != '\0'; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '.' &&
+            *p != '-')
+            *p = '_';
+    }
+
+    return result;
+}
+
+/* Fails early, before any row is deleted, when files cannot be created. */
+static void check_archive_directory(void)
+{
+    struct stat st;
+
+    if (stat(ttl_archive_directory, &st) < 0) {
+        if (errno == ENOENT)
+            ereport(ERROR,
+                    (errcode(ERRCODE_UNDEFINED_FILE),
+                     errmsg("archive directory \"%s\" does not exist",
+                            ttl_archive_directory)));
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not stat archive directory \"%s\": %m",
+                        ttl_archive_directory)));
+    }
+
+    if (!S_ISDIR(st.st_mode))
+        ereport(ERROR,
+                (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+                 errmsg("archive directory \"%s\" is not a directory",
+                        ttl_archive_directory)));
+
+    if (access(ttl_archive_directory, W_OK | X_OK) < 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+                 errmsg("archive directory \"%s\" is not writable",
+                        ttl_archive_directory)));
+}
+
+/*
+ * Takes an exclusive flock() on an open archive file.  This lock is what
+ * guarantees a single writer per file: the file prefix keeps databases and
+ * rules apart, but sanitizing can map two rules to one name, and the
+ * runner's advisory locks are per database.  The lock is released when the
+ * file is closed.  Waits last at most one batch write and stay
+ * interruptible.
+ */
+static void lock_archive_file(int fd, const char *path)
+{
+    while (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            int save_errno = errno;
+
+            CloseTransientFile(fd);
+            errno = save_errno;
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not lock archive file \"%s\": %m", path)));
+        }
+
+        CHECK_FOR_INTERRUPTS();
+        pg_usleep(TTL_ARCHIVE_LOCK_RETRY_USEC);
+    }
+}
+
+/*
+ * Opens and locks the archive file for this batch.  Files are named
+ * <database oid>.<prefix>_<period start>_<segment>, where the period start
+ * rotates every pg_ttl_index.archive_rotation_age seconds and the segment
+ * number advances once a file reaches pg_ttl_index.archive_rotation_size.
+ * The size is checked under the lock, so concurrent writers agree on the
+ * segment.  Sets *created when the file is new (empty).
+ */
+static int open_archive_file(char *path, const char *prefix, bool *created)
+{
+    pg_time_t now = timestamptz_to_time_t(GetCurrentTimestamp());
+    pg_time_t period_start = now - (now % ttl_archive_rotation_age);
+    off_t size_limit = (off_t)ttl_archive_rotation_size_mb * TTL_BYTES_PER_MB;
+    char *safe_prefix = sanitize_file_prefix(prefix);
+    char stamp[32];
+    int segment;
+
+    pg_strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ",
+                pg_gmtime(&period_start));
+
+    for (segment = 0; segment < TTL_ARCHIVE_MAX_SEGMENTS; segment++) {
+        struct stat st;
+        int fd;
+
+        snprintf(path, MAXPGPATH, "%s/%u.%s_%s_%04d" TTL_ARCHIVE_SUFFIX,
+                 ttl_archive_directory, MyDatabaseId, safe_prefix, stamp,
+                 segment);
+
+        fd = OpenTransientFile(path,
+                               O_WRONLY | O_CREAT | O_APPEND | PG_BINARY);
+        if (fd < 0)
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not open archive file \"%s\": %m", path)));
+
+        lock_archive_file(fd, path);
+
+        if (fstat(fd, &st) < 0) {
+            int save_errno = errno;
+
+            CloseTransientFile(fd);
+            errno = save_errno;
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not stat archive file \"%s\": %m", path)));
+        }
+
+        if (st.st_size < size_limit) {
+            *created = (st.st_size == 0);
+            pfree(safe_prefix);
+            return fd;
+        }
+
+        CloseTransientFile(fd);
+    }
+
+    ereport(ERROR,
+            (errmsg("TTL archive: too many archive segments for \"%s\"",
+                    safe_prefix),
+             errhint("Increase pg_ttl_index.archive_rotation_size.")));
+    return -1; /* keep compiler quiet */
+}
+
+/*
+ * Opens and locks the archive file for a batch.  With zlib the whole batch
+ * becomes one gzip member; concatenated members are a valid gzip stream, so
+ * the file can be read back with zcat.
+ */
+static void begin_archive_write(ArchiveFile *file, const char *prefix)
+{
+    file->fd = open_archive_file(file->path, prefix, &file->created);
+
+#ifdef HAVE_LIBZ
+    {
+        int gz_fd = dup(file->fd);
+
+        if (gz_fd < 0) {
+            int save_errno = errno;
+
+            CloseTransientFile(file->fd);
+            errno = save_errno;
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not open archive file \"%s\": %m",
+                            file->path)));
+        }
+
+        file->gz = gzdopen(gz_fd, "ab");
+        if (file->gz == NULL) {
+            close(gz_fd);
+            CloseTransientFile(file->fd);
+            ereport(ERROR,
+                    (errmsg("could not initialize compression for archive "
+                            "file \"%s\"",
+                            file->path)));
+        }
+
+        gzbuffer(file->gz, TTL_ARCHIVE_WRITE_BUFFER_SIZE);
+    }
+#endif
+}
+
+/* Appends one chunk of formatted rows. */
+static void append_archive_rows(ArchiveFile *file, StringInfo buf)
+{
+#ifdef HAVE_LIBZ
+    if (gzwrite(file->gz, buf->data, buf->len) != buf->len)
+        ereport(ERROR,
+                (errmsg("could not write compressed archive file \"%s\"",
+                        file->path)));
+#else
+    errno = 0;
+    if (write(file->fd, buf->data, buf->len) != buf->len) {
+        if (errno == 0)
+            errno = ENOSPC;
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not write archive file \"%s\": %m",
+                        file->path)));
+    }
+#endif
+}
+
+/*
+ * Releases the file after an error.  Chunks hold whole rows, so closing the
+ * gzip member leaves a readable file; the rows in it are archived again when
+ * the batch is retried.  The transient file itself is closed at abort.
+ */
+static void abort_archive_write(ArchiveFile *file)
+{
+#ifdef HAVE_LIBZ
+    gzclose(file->gz);
+#endif
+}
+
+/* Ends the gzip member, fsyncs the file and closes it, releasing the lock. */
+static void finish_archive_write(ArchiveFile *file)
+{
+#ifdef HAVE_LIBZ
+    if (gzclose(file->gz) != Z_OK) {
+        CloseTransientFile(file->fd);
+        ereport(ERROR,
+                (errmsg("could not write compressed archive file \"%s\"",
+                        file->path)));
+    }
+#endif
+
+    if (pg_fsync(file->fd) != 0) {
+        int save_errno = errno;
+
+        CloseTransientFile(file->fd);
+        errno = save_errno;
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not fsync archive file \"%s\": %m",
+                        file->path)));
+    }
+
+    if (CloseTransientFile(file->fd) != 0)
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not close archive file \"%s\": %m",
+                        file->path)));
+}
+
+/* Makes a newly created archive file's directory entry durable. */
+static void fsync_archive_directory(void)
+{
+    int fd;
+
+    fd = OpenTransientFile(ttl_archive_directory, O_RDONLY | PG_BINARY);
+    if (fd < 0)
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not open archive directory \"%s\": %m",
+                               ttl_archive_directory)));
+
+    if (pg_fsync(fd) != 0) {
+        int save_errno = errno;
+
+        CloseTransientFile(fd);
+        errno = save_errno;
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not fsync archive directory \"%s\": %m",
+                               ttl_archive_directory)));
+    }
+
+    CloseTransientFile(fd);
+}
@@ -12,6 +12,22 @@ PG_MODULE_MAGIC;
 /* Define gloabl variables */
 int ttl_naptime = TTL_DEFAULT_NAPTIME_SECONDS;
 bool ttl_worker_enabled = true;
+int ttl_lock_timeout = TTL_DEFAULT_LOCK_TIMEOUT_MS;
+int ttl_cycle_time_budget = 0;
+int ttl_rule_time_quantum = TTL_DEFAULT_RULE_TIME_QUANTUM_MS;
+int ttl_expiry_lag_warning = 0;
+int ttl_load_watermark = 0;
+int ttl_catchup_batch_factor = TTL_DEFAULT_CATCHUP_BATCH_FACTOR;
+char *ttl_maintenance_window = NULL;
+bool ttl_maintenance_window_only = false;
+bool ttl_profile_enabled = false;
+double ttl_explain_sample_rate = 0.0;
+int ttl_log_min_duration = -1;
+int ttl_failure_backoff = TTL_DEFAULT_FAILURE_BACKOFF_SECONDS;
+int ttl_max_consecutive_failures = TTL_DEFAULT_MAX_CONSECUTIVE_FAILURES;
+char *ttl_archive_directory = NULL;
+int ttl_archive_rotation_size_mb = TTL_DEFAULT_ARCHIVE_ROTATION_SIZE_MB;
+int ttl_archive_rotation_age = TTL_DEFAULT_ARCHIVE_ROTATION_AGE_SECONDS;
 
 void _PG_init(void);
 
@@ -25,4 +41,117 @@ void _PG_init(void)
     DefineCustomBoolVariable(
         "pg_ttl_index.enabled", "Enable TTL background worker", NULL,
         &ttl_worker_enabled, true, PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.lock_timeout",
+        "Lock timeout applied while ttl_runner() expires rows (milliseconds)",
+        "Zero keeps the session's own lock_timeout.", &ttl_lock_timeout,
+        TTL_DEFAULT_LOCK_TIMEOUT_MS, 0, INT_MAX, PGC_SUSET, 0, NULL, NULL,
+        NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.cycle_time_budget",
+        "Time after which ttl_runner() stops starting batches (milliseconds)",
+        "Zero means no limit.", &ttl_cycle_time_budget, 0, 0, INT_MAX,
+        PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.rule_time_quantum",
+        "Time one TTL rule may spend per ttl_runner() call (milliseconds)",
+        "Zero means a rule runs until its backlog is drained.",
+        &ttl_rule_time_quantum, TTL_DEFAULT_RULE_TIME_QUANTUM_MS, 0, INT_MAX,
+        PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.expiry_lag_warning",
+        "Expiry lag above which ttl_runner() emits a WARNING (seconds)",
+        "Zero disables the warning.", &ttl_expiry_lag_warning, 0, 0, INT_MAX,
+        PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.load_watermark",
+        "Active client backends at or above which ttl_runner() defers work",
+        "Only high-priority rules run above the watermark. Zero disables "
+        "load-aware scheduling.",
+        &ttl_load_watermark, 0, 0, INT_MAX, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.catchup_batch_factor",
+        "Batch size multiplier for deferred rules while load is at or below "
+        "half the load watermark",
+        "Applies until a pass of the rule finishes.", &ttl_catchup_batch_factor, TTL_DEFAULT_CATCHUP_BATCH_FACTOR, 1,
+        1000, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomStringVariable(
+        "pg_ttl_index.maintenance_window",
+        "Daily window in which TTL rules run unthrottled, e.g. "
+        "'02:00-05:00 UTC'",
+        "Usually set per database with ALTER DATABASE. Rules with their own "
+        "window ignore it.",
+        &ttl_maintenance_window, "", PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomBoolVariable(
+        "pg_ttl_index.maintenance_window_only",
+        "Run TTL rules only inside pg_ttl_index.maintenance_window", NULL,
+        &ttl_maintenance_window_only, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomBoolVariable(
+        "pg_ttl_index.profile",
+        "Record per-phase timing of each ttl_runner() call",
+        "The last profile is shown by ttl_last_run_profile().",
+        &ttl_profile_enabled, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomRealVariable(
+        "pg_ttl_index.explain_sample_rate",
+        "Fraction of TTL passes whose first batch is captured with EXPLAIN "
+        "ANALYZE",
+        "The plan is stored in ttl_index_table.last_plan. Zero disables "
+        "plan capture.",
+        &ttl_explain_sample_rate, 0.0, 0.0, 1.0, PGC_SUSET, 0, NULL, NULL,
+        NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.log_min_duration",
+        "TTL passes and batches running at least this long are logged as "
+        "JSON (milliseconds)",
+        "Zero logs every pass and batch; -1 disables the log.",
+        &ttl_log_min_duration, -1, -1, INT_MAX, PGC_SUSET, 0, NULL, NULL,
+        NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.failure_backoff",
+        "Delay before a failed TTL rule is retried, doubled on each further "
+        "consecutive failure (seconds)",
+        "The delay is capped at one day. Zero retries on every run.",
+        &ttl_failure_backoff, TTL_DEFAULT_FAILURE_BACKOFF_SECONDS, 0, INT_MAX,
+        PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.max_consecutive_failures",
+        "Consecutive failures after which a TTL rule is quarantined",
+        "Quarantined rules are skipped until ttl_release_rule() or "
+        "ttl_create_index() is called for them. Objects in use by another "
+        "session never quarantine a rule, and lock timeouts are not "
+        "failures. Zero disables quarantine.",
+        &ttl_max_consecutive_failures, TTL_DEFAULT_MAX_CONSECUTIVE_FAILURES,
+        0, INT_MAX, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomStringVariable(
+        "pg_ttl_index.archive_directory",
+        "Directory for archive files written by archive-mode TTL rules",
+        "Relative paths are resolved against the data directory.",
+        &ttl_archive_directory, "", PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.archive_rotation_size",
+        "Archive file size that triggers rotation to a new file (MB)", NULL,
+        &ttl_archive_rotation_size_mb, TTL_DEFAULT_ARCHIVE_ROTATION_SIZE_MB, 1,
+        INT_MAX / 1024, PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable(
+        "pg_ttl_index.archive_rotation_age",
+        "Archive file age that triggers rotation to a new file (seconds)",
+        NULL, &ttl_archive_rotation_age,
+        TTL_DEFAULT_ARCHIVE_ROTATION_AGE_SECONDS, 1, INT_MAX, PGC_SUSET, 0,
+        NULL, NULL, NULL);
 }
@@ -16,9 +16,36 @@
 #define TTL_MAIN_FUNCTION_NAME "ttl_worker_main"
 #define TTL_QUERY_LIMIT 1
 
+#define TTL_DEFAULT_LOCK_TIMEOUT_MS 1000
+#define TTL_DEFAULT_RULE_TIME_QUANTUM_MS 30000
+#define TTL_DEFAULT_CATCHUP_BATCH_FACTOR 4
+#define TTL_DEFAULT_FAILURE_BACKOFF_SECONDS 60
+#define TTL_DEFAULT_MAX_CONSECUTIVE_FAILURES 10
+
+/* Archive file defaults */
+#define TTL_DEFAULT_ARCHIVE_ROTATION_SIZE_MB 1024
+#define TTL_DEFAULT_ARCHIVE_ROTATION_AGE_SECONDS 86400
+#define TTL_BYTES_PER_MB (1024L * 1024L)
+
 /* Global configuration variables */
 extern int ttl_naptime;
 extern bool ttl_worker_enabled;
+extern int ttl_lock_timeout;
+extern int ttl_cycle_time_budget;
+extern int ttl_rule_time_quantum;
+extern int ttl_expiry_lag_warning;
+extern int ttl_load_watermark;
+extern int ttl_catchup_batch_factor;
+extern char *ttl_maintenance_window;
+extern bool ttl_maintenance_window_only;
+extern bool ttl_profile_enabled;
+extern double ttl_explain_sample_rate;
+extern int ttl_log_min_duration;
+extern int ttl_failure_backoff;
+extern int ttl_max_consecutive_failures;
+extern char *ttl_archive_directory;
+extern int ttl_archive_rotation_size_mb;
+extern int ttl_archive_rotation_age;
 
 /* Shared function declarations for background worker */
 void configure_background_worker(BackgroundWorker *worker);
@@ -0,0 +1,192 @@
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "executor/instrument.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/pg_rusage.h"
+#include "utils/tuplestore.h"
+
+#include "pg_ttl_index.h"
+
+#define TTL_PROFILE_MAX_PHASES 32
+#define TTL_PROFILE_PHASE_NAME_LEN 32
+#define TTL_PROFILE_COLUMNS 4
+#define TTL_IO_USAGE_FIELDS 4
+
+PG_FUNCTION_INFO_V1(ttl_profile_reset);
+PG_FUNCTION_INFO_V1(ttl_profile_phase);
+PG_FUNCTION_INFO_V1(ttl_profile_collect);
+PG_FUNCTION_INFO_V1(ttl_io_usage);
+
+/* Time accumulated in one phase of a ttl_runner() call */
+typedef struct TtlProfilePhase {
+    char name[TTL_PROFILE_PHASE_NAME_LEN];
+    int64 calls;
+    instr_time wall;
+    double cpu_ms;
+} TtlProfilePhase;
+
+/*
+ * Backend-local: the profile lives outside transaction state, so phases
+ * that end in an error are still counted.
+ */
+static TtlProfilePhase profile_phases[TTL_PROFILE_MAX_PHASES];
+static int profile_num_phases = 0;
+static int profile_current_phase = -1;
+static instr_time profile_phase_start;
+static double profile_phase_start_cpu_ms;
+
+/* Static function declarations */
+static double process_cpu_time_ms(void);
+static int lookup_profile_phase(const char *name);
+
+/* Forgets the previous run's profile. */
+Datum ttl_profile_reset(PG_FUNCTION_ARGS)
+{
+    memset(profile_phases, 0, sizeof(profile_phases));
+    profile_num_phases = 0;
+    profile_current_phase = -1;
+
+    PG_RETURN_VOID();
+}
+
+/*
+ * Ends the current phase and starts the named one; NULL only ends it.  Wall
+ * time is taken with INSTR_TIME and CPU time (user + system) with
+ * getrusage().  Does nothing unless pg_ttl_index.profile is on.
+ */
+Datum ttl_profile_phase(PG_FUNCTION_ARGS)
+{
+    instr_time now;
+    double cpu_ms;
+
+    if (!ttl_profile_enabled)
+        PG_RETURN_VOID();
+
+    INSTR_TIME_SET_CURRENT(now);
+    cpu_ms = process_cpu_time_ms();
+
+    if (profile_current_phase >= 0) {
+        TtlProfilePhase *phase = &profile_phases[profile_current_phase];
+
+        INSTR_TIME_ACCUM_DIFF(phase->wall, now, profile_phase_start);
+        phase->cpu_ms += cpu_ms - profile_phase_start_cpu_ms;
+        profile_current_phase = -1;
+    }
+
+    if (!PG_ARGISNULL(0)) {
+        char *name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+
+        profile_current_phase = lookup_profile_phase(name);
+        profile_phases[profile_current_phase].calls++;
+        profile_phase_start = now;
+        profile_phase_start_cpu_ms = cpu_ms;
+        pfree(name);
+    }
+
+    PG_RETURN_VOID();
+}
+
+/* Returns (phase, calls, wall_ms, cpu_ms) for each phase in this backend. */
+Datum ttl_profile_collect(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore;
+    MemoryContext oldcontext;
+    int i;
+
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+        !(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                 errmsg("set-valued function called in context that cannot "
+                        "accept a set")));
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+
+    for (i = 0; i < profile_num_phases; i++) {
+        TtlProfilePhase *phase = &profile_phases[i];
+        Datum values[TTL_PROFILE_COLUMNS];
+        bool nulls[TTL_PROFILE_COLUMNS] = {false};
+
+        values[0] = CStringGetTextDatum(phase->name);
+        values[1] = Int64GetDatum(phase->calls);
+        values[2] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(phase->wall));
+        values[3] = Float8GetDatum(phase->cpu_ms);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    return (Datum)0;
+}
+
+/*
+ * Returns this backend's cumulative {shared_blks_hit, shared_blks_read,
+ * shared_blks_dirtied, wal_bytes}; callers diff two snapshots.  The counters
+ * are maintained by the buffer manager and WAL insertion whether or not
+ * anything is being instrumented.  WAL usage is not tracked before
+ * PostgreSQL 13, so wal_bytes is NULL there.
+ */
+Datum ttl_io_usage(PG_FUNCTION_ARGS)
+{
+    Datum values[TTL_IO_USAGE_FIELDS];
+    bool nulls[TTL_IO_USAGE_FIELDS] = {false};
+    int dims[1] = {TTL_IO_USAGE_FIELDS};
+    int lbs[1] = {1};
+
+    values[0] = Int64GetDatum(pgBufferUsage.shared_blks_hit);
+    values[1] = Int64GetDatum(pgBufferUsage.shared_blks_read);
+    values[2] = Int64GetDatum(pgBufferUsage.shared_blks_dirtied);
+#if PG_VERSION_NUM >= 130000
+    values[3] = Int64GetDatum((int64)pgWalUsage.wal_bytes);
+#else
+    values[3] = (Datum)0;
+    nulls[3] = true;
+#endif
+
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(values, nulls, 1, dims, lbs,
+                                             INT8OID, sizeof(int64),
+                                             FLOAT8PASSBYVAL, 'd'));
+}
+
+static double process_cpu_time_ms(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static int lookup_profile_phase(const char *name)
+{
+    int i;
+
+    for (i = 0; i < profile_num_phases; i++) {
+        if (strcmp(profile_phases[i].name, name) == 0)
+            return i;
+    }
+
+    if (profile_num_phases >= TTL_PROFILE_MAX_PHASES)
+        ereport(ERROR, (errmsg("TTL profile: too many phases")));
+
+    strlcpy(profile_phases[i].name, name, TTL_PROFILE_PHASE_NAME_LEN);
+    profile_num_phases++;
+
+    return i;
+}
@@ -4,13 +4,18 @@
 #include "executor/spi.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
+#include "nodes/plannodes.h"
 #include "pgstat.h"
 #include "postmaster/bgworker.h"
+#include "replication/origin.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/snapmgr.h"
 
 #include "pg_ttl_index.h"
@@ -30,8 +35,14 @@ static void set_worker_application_name(Oid database_id);
 static bool should_perform_cleanup(int wait_result);
 static bool can_perform_cleanup(void);
 static void perform_ttl_cleanup(void);
+static long compute_wait_timeout(void);
 static void handle_cleanup_error(void);
+static char *lookup_extension_schema(void);
 static void execute_ttl_runner_in_extension_schema(void);
+static void build_pending_indexes(void);
+static List *fetch_pending_index_ddl(MemoryContext context);
+static void execute_top_level_utility(const char *sql, MemoryContext context);
+static void handle_index_build_error(const char *sql, MemoryContext context);
 
 static void ttl_sigterm_handler(SIGNAL_ARGS)
 {
@@ -70,8 +81,7 @@ void ttl_worker_main(Datum main_arg)
 #else
                                 WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
 #endif
-                                (long)ttl_naptime * TTL_MILLISECONDS_PER_SECOND,
-                                PG_WAIT_EXTENSION);
+                                compute_wait_timeout(), PG_WAIT_EXTENSION);
 
         if (got_SIGTERM)
             break;
@@ -136,6 +146,8 @@ static bool can_perform_cleanup(void)
 
 static void perform_ttl_cleanup(void)
 {
+    build_pending_indexes();
+
     PG_TRY();
     {
         StartTransactionCommand();
@@ -158,11 +170,73 @@ static void perform_ttl_cleanup(void)
     PG_END_TRY();
 }
 
-static void execute_ttl_runner_in_extension_schema(void)
+/*
+ * Returns how long to sleep before the next cleanup: the naptime, shortened
+ * so that the worker wakes up when a maintenance window opens or closes.
+ */
+static long compute_wait_timeout(void)
+{
+    long naptime_ms = (long)ttl_naptime * TTL_MILLISECONDS_PER_SECOND;
+    volatile long timeout = naptime_ms;
+
+    if (!can_perform_cleanup())
+        return naptime_ms;
+
+    PG_TRY();
+    {
+        char *schema_name;
+
+        StartTransactionCommand();
+
+        if (SPI_connect() != SPI_OK_CONNECT)
+            ereport(ERROR, (errmsg("TTL worker: SPI_connect failed")));
+
+        PushActiveSnapshot(GetTransactionSnapshot());
+
+        schema_name = lookup_extension_schema();
+        if (schema_name != NULL) {
+            StringInfoData query;
+            bool isnull;
+            Datum value;
+            int ret;
+
+            initStringInfo(&query);
+            appendStringInfo(&query,
+                             "SELECT pg_catalog.ceil(EXTRACT(EPOCH FROM "
+                             "%s.ttl_next_window_boundary() - "
+                             "pg_catalog.clock_timestamp()) * 1000)::int8",
+                             quote_identifier(schema_name));
+            ret = SPI_exec(query.data, TTL_QUERY_LIMIT);
+            pfree(query.data);
+
+            if (ret != SPI_OK_SELECT)
+                ereport(ERROR, (errmsg("TTL worker: failed to compute next "
+                                       "maintenance window boundary")));
+
+            value = SPI_getbinval(SPI_tuptable->vals[0],
+                                  SPI_tuptable->tupdesc, 1, &isnull);
+            if (!isnull && DatumGetInt64(value) < naptime_ms)
+                timeout = (long)Max(DatumGetInt64(value), 1);
+        }
+
+        PopActiveSnapshot();
+        SPI_finish();
+        CommitTransactionCommand();
+    }
+    PG_CATCH();
+    {
+        handle_cleanup_error();
+        timeout = naptime_ms;
+    }
+    PG_END_TRY();
+
+    return timeout;
+}
+
+static char *lookup_extension_schema(void)
 {
     int ret;
     char *schema_name = NULL;
-    StringInfoData query;
 
     ret = SPI_exec("SELECT n.nspname "
                    "FROM pg_catalog.pg_extension e "
@@ -175,13 +249,26 @@ static void execute_ttl_runner_in_extension_schema(void)
                 (errmsg("TTL worker: failed to lookup extension schema")));
 
     if (SPI_processed == 0)
-        return;
+        return NULL;
 
     schema_name = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
     if (schema_name == NULL || schema_name[0] == '\0')
         ereport(ERROR,
                 (errmsg("TTL worker: extension schema lookup returned NULL")));
 
+    return schema_name;
+}
+
+static void execute_ttl_runner_in_extension_schema(void)
+{
+    int ret;
+    char *schema_name;
+    StringInfoData query;
+
+    schema_name = lookup_extension_schema();
+    if (schema_name == NULL)
+        return;
+
     initStringInfo(&query);
     appendStringInfo(&query, "SELECT %s.ttl_runner()",
                      quote_identifier(schema_name));
@@ -192,6 +279,164 @@ static void execute_ttl_runner_in_extension_schema(void)
         ereport(ERROR, (errmsg("TTL worker: failed to execute ttl_runner()")));
 }
 
+/*
+ * Builds indexes queued by ttl_create_index(..., p_concurrently => true).
+ * CREATE INDEX CONCURRENTLY cannot run inside a transaction block or a
+ * function, so each statement is executed here as a top-level utility
+ * command in its own transaction.  ttl_runner() activates the rule once the
+ * index is valid.
+ */
+static void build_pending_indexes(void)
+{
+    MemoryContext ddl_context;
+    List *statements;
+    ListCell *lc;
+
+    ddl_context = AllocSetContextCreate(
+        TopMemoryContext, "TTL pending index DDL", ALLOCSET_DEFAULT_SIZES);
+
+    statements = fetch_pending_index_ddl(ddl_context);
+
+    foreach (lc, statements) {
+        const char *sql = (const char *)lfirst(lc);
+
+        PG_TRY();
+        {
+            StartTransactionCommand();
+            PushActiveSnapshot(GetTransactionSnapshot());
+            pgstat_report_activity(STATE_RUNNING, sql);
+
+            execute_top_level_utility(sql, ddl_context);
+
+            /* Concurrent builds pop the snapshot themselves */
+            if (ActiveSnapshotSet())
+                PopActiveSnapshot();
+            CommitTransactionCommand();
+            pgstat_report_activity(STATE_IDLE, NULL);
+        }
+        PG_CATCH();
+        {
+            handle_index_build_error(sql, ddl_context);
+        }
+        PG_END_TRY();
+    }
+
+    MemoryContextDelete(ddl_context);
+}
+
+static List *fetch_pending_index_ddl(MemoryContext context)
+{
+    List *volatile statements = NIL;
+
+    PG_TRY();
+    {
+        char *schema_name;
+
+        StartTransactionCommand();
+
+        if (SPI_connect() != SPI_OK_CONNECT)
+            ereport(ERROR, (errmsg("TTL worker: SPI_connect failed")));
+
+        PushActiveSnapshot(GetTransactionSnapshot());
+
+        schema_name = lookup_extension_schema();
+        if (schema_name != NULL) {
+            StringInfoData query;
+            MemoryContext oldcontext;
+            uint64 i;
+            int ret;
+
+            initStringInfo(&query);
+            appendStringInfo(&query, "SELECT %s.ttl_pending_index_ddl()",
+                             quote_identifier(schema_name));
+            ret = SPI_exec(query.data, 0);
+            pfree(query.data);
+
+            if (ret != SPI_OK_SELECT)
+                ereport(ERROR, (errmsg("TTL worker: failed to fetch pending "
+                                       "index builds")));
+
+            /* Statements must survive the transaction commits below */
+            oldcontext = MemoryContextSwitchTo(context);
+            for (i = 0; i < SPI_processed; i++) {
+                char *ddl = SPI_getvalue(SPI_tuptable->vals[i],
+                                         SPI_tuptable->tupdesc, 1);
+
+                if (ddl != NULL)
+                    statements = lappend(statements, ddl);
+            }
+            MemoryContextSwitchTo(oldcontext);
+        }
+
+        PopActiveSnapshot();
+        SPI_finish();
+        CommitTransactionCommand();
+    }
+    PG_CATCH();
+    {
+        handle_cleanup_error();
+        statements = NIL;
+    }
+    PG_END_TRY();
+
+    return statements;
+}
+
+static void execute_top_level_utility(const char *sql, MemoryContext context)
+{
+    MemoryContext oldcontext;
+    List *parsetree_list;
+    ListCell *lc;
+
+    /*
+     * Concurrent index builds commit and restart the transaction midway, so
+     * the parse tree must not live in a transaction memory context.
+     */
+    oldcontext = MemoryContextSwitchTo(context);
+    parsetree_list = pg_parse_query(sql);
+    MemoryContextSwitchTo(oldcontext);
+
+    foreach (lc, parsetree_list) {
+        RawStmt *raw = lfirst_node(RawStmt, lc);
+        PlannedStmt *pstmt;
+
+        oldcontext = MemoryContextSwitchTo(context);
+        pstmt = makeNode(PlannedStmt);
+        pstmt->commandType = CMD_UTILITY;
+        pstmt->canSetTag = true;
+        pstmt->utilityStmt = raw->stmt;
+        pstmt->stmt_location = raw->stmt_location;
+        pstmt->stmt_len = raw->stmt_len;
+        MemoryContextSwitchTo(oldcontext);
+
+        ProcessUtility(pstmt, sql,
+#if PG_VERSION_NUM >= 140000
+                       false,
+#endif
+                       PROCESS_UTILITY_TOPLEVEL, NULL, NULL, None_Receiver,
+                       NULL);
+    }
+}
+
+static void handle_index_build_error(const char *sql, MemoryContext context)
+{
+    ErrorData *edata;
+
+    MemoryContextSwitchTo(context);
+    edata = CopyErrorData();
+    FlushErrorState();
+
+    AbortCurrentTransaction();
+    pgstat_report_activity(STATE_IDLE, NULL);
+
+    ereport(WARNING,
+            (errmsg("TTL worker: failed to build pending index: %s",
+                    edata->message),
+             errdetail("Statement: %s", sql)));
+
+    FreeErrorData(edata);
+}
+
 static void handle_cleanup_error(void)
 {
     ErrorData *edata;
@@ -212,6 +457,26 @@ static void handle_cleanup_error(void)
     PG_END_TRY();
 
     AbortCurrentTransaction();
+
+    /*
+     * The replication origin of a rule is session state and survives the
+     * abort; later runs must not have their changes tagged with it.
+     */
+    if (replorigin_session_origin != InvalidRepOriginId) {
+        PG_TRY();
+        {
+            replorigin_session_reset();
+        }
+        PG_CATCH();
+        {
+            FlushErrorState();
+        }
+        PG_END_TRY();
+
+        replorigin_session_origin = InvalidRepOriginId;
+        replorigin_session_origin_lsn = InvalidXLogRecPtr;
+        replorigin_session_origin_timestamp = 0;
+    }
 }
 
 void configure_background_worker(BackgroundWorker *worker)
@@ -0,0 +1,34 @@
+# Runners split the rule set by table: while another session holds a table's
+# runner lock, all of its rules are skipped, and they run once it is released.
+
+setup
+{
+    CREATE EXTENSION pg_ttl_index;
+    CREATE TABLE ttl_lock_test (
+        id INTEGER PRIMARY KEY,
+        tier TEXT NOT NULL,
+        created_at TIMESTAMPTZ NOT NULL
+    );
+    SELECT ttl_create_index('ttl_lock_test', 'created_at', 86400, p_row_filter => 'tier = ''free''');
+    SELECT ttl_create_index('ttl_lock_test', 'created_at', 86400, p_row_filter => 'tier = ''paid''');
+    INSERT INTO ttl_lock_test
+    SELECT g, CASE WHEN g % 2 = 0 THEN 'free' ELSE 'paid' END, NOW() - INTERVAL '2 days'
+    FROM pg_catalog.generate_series(1, 4) AS g;
+}
+
+teardown
+{
+    DROP TABLE ttl_lock_test;
+    DROP EXTENSION pg_ttl_index;
+}
+
+session s1
+step s1_begin { BEGIN; }
+step s1_lock { SELECT pg_advisory_xact_lock(hashtext('pg_ttl_index'), 'ttl_lock_test'::regclass::oid::integer); }
+step s1_commit { COMMIT; }
+
+session s2
+step s2_run { SELECT ttl_runner(); }
+step s2_remaining { SELECT tier, count(*) FROM ttl_lock_test GROUP BY tier ORDER BY tier; }
+
+permutation s1_begin s1_lock s2_run s2_remaining s1_commit s2_run s2_remaining
@@ -0,0 +1,41 @@
+# Expiry never waits for rows another transaction has locked: they are skipped
+# and expired by a later run. Waits that remain, such as on the table lock, are
+# bounded by pg_ttl_index.lock_timeout, and a timeout defers the rule to the
+# next run without counting as an error.
+
+setup
+{
+    CREATE EXTENSION pg_ttl_index;
+    CREATE TABLE ttl_skip_test (
+        id INTEGER PRIMARY KEY,
+        created_at TIMESTAMPTZ NOT NULL
+    );
+    SELECT ttl_create_index('ttl_skip_test', 'created_at', 86400);
+    INSERT INTO ttl_skip_test
+    SELECT g, NOW() - INTERVAL '2 days'
+    FROM pg_catalog.generate_series(1, 6) AS g;
+}
+
+teardown
+{
+    DROP TABLE ttl_skip_test;
+    DROP EXTENSION pg_ttl_index;
+}
+
+session s1
+step s1_begin { BEGIN; }
+step s1_lock_rows { SELECT id FROM ttl_skip_test WHERE id <= 2 ORDER BY id FOR UPDATE; }
+step s1_lock_table { LOCK TABLE ttl_skip_test IN ACCESS EXCLUSIVE MODE; }
+step s1_commit { COMMIT; }
+
+session s2
+setup { SET pg_ttl_index.lock_timeout = 200; }
+step s2_run { SELECT ttl_runner(); }
+step s2_remaining { SELECT id FROM ttl_skip_test ORDER BY id; }
+step s2_rule { SELECT deferred_since IS NOT NULL AS deferred, total_errors, consecutive_failures, next_attempt_at IS NULL AS retry_next_run FROM ttl_index_table; }
+
+# Locked rows are skipped, not waited for
+permutation s1_begin s1_lock_rows s2_run s2_remaining s1_commit s2_run s2_remaining
+
+# A lock timeout defers the rule; the next run expires its rows
+permutation s1_begin s1_lock_table s2_run s2_rule s1_commit s2_run s2_rule s2_remaining
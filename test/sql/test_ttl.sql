@@ -5,6 +5,28 @@
  * Run with: make installcheck
  */
 
+-- Upgrade from the released 3.0.0
+DROP EXTENSION IF EXISTS pg_ttl_index CASCADE;
+CREATE EXTENSION pg_ttl_index VERSION '3.0.0';
+
+CREATE TABLE test_upgrade (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMP NOT NULL
+);
+
+INSERT INTO test_upgrade (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 3);
+
+SELECT ttl_create_index('test_upgrade', 'created_at', 86400, 2);
+
+ALTER EXTENSION pg_ttl_index UPDATE TO '3.1.0';
+SELECT extversion FROM pg_extension WHERE extname = 'pg_ttl_index';
+
+-- The rule survives the upgrade and runs
+SELECT ttl_runner();
+
+SELECT ttl_drop_index('test_upgrade', 'created_at');
+DROP TABLE test_upgrade;
+
 -- Basic extension installation test
 DROP EXTENSION IF EXISTS pg_ttl_index CASCADE;
 CREATE EXTENSION IF NOT EXISTS pg_ttl_index;
@@ -170,5 +192,883 @@ WHERE table_name = 'test_soft_delete';
 SELECT ttl_drop_index('test_soft_delete', 'created_at');
 DROP TABLE test_soft_delete;
 
+-- Test 11: Archive table mode moves expired rows in one statement
+CREATE TABLE test_archive_source (
+    id SERIAL PRIMARY KEY,
+    payload TEXT,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+CREATE TABLE test_archive_target (LIKE test_archive_source);
+
+SELECT ttl_create_index('test_archive_source', 'created_at', 3600,
+                        p_archive_table => 'test_archive_target');
+
+INSERT INTO test_archive_source (payload, created_at) VALUES
+    ('expired', NOW() - INTERVAL '2 hours'),
+    ('fresh', NOW());
+
+SELECT ttl_runner();
+
+SELECT payload AS source_rows FROM test_archive_source;
+SELECT payload AS archived_rows FROM test_archive_target;
+
+SELECT table_name, cleanup_mode, archive_table
+FROM ttl_summary()
+WHERE table_name = 'test_archive_source';
+
+SELECT ttl_drop_index('test_archive_source', 'created_at');
+DROP TABLE test_archive_source;
+DROP TABLE test_archive_target;
+
+-- Test 12: Soft delete purge hard-deletes rows after the grace period
+CREATE TABLE test_soft_purge (
+    id SERIAL PRIMARY KEY,
+    payload TEXT,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW(),
+    deleted_at TIMESTAMPTZ
+);
+
+SELECT ttl_create_index('test_soft_purge', 'created_at', 3600, 1000, 'deleted_at',
+                        p_soft_delete_grace_seconds => 3600);
+
+INSERT INTO test_soft_purge (payload, created_at, deleted_at) VALUES
+    ('purge', NOW() - INTERVAL '3 hours', NOW() - INTERVAL '2 hours'),
+    ('mark', NOW() - INTERVAL '2 hours', NULL),
+    ('fresh', NOW(), NULL);
+
+SELECT ttl_runner();
+
+SELECT payload, deleted_at IS NOT NULL AS is_marked
+FROM test_soft_purge
+ORDER BY id;
+
+SELECT rows_deleted_last_run, total_rows_purged
+FROM ttl_summary()
+WHERE table_name = 'test_soft_purge';
+
+SELECT ttl_drop_index('test_soft_purge', 'created_at');
+DROP TABLE test_soft_purge;
+
+-- Test 13: Soft delete rules use a partial index on unmarked rows
+CREATE TABLE test_soft_partial (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW(),
+    deleted_at TIMESTAMPTZ
+);
+
+SELECT ttl_create_index('test_soft_partial', 'created_at', 3600, 1000, 'deleted_at');
+
+SELECT indexname, indexdef LIKE '%WHERE (deleted_at IS NULL)' AS is_partial
+FROM pg_indexes
+WHERE tablename = 'test_soft_partial' AND indexname LIKE 'idx_ttl%';
+
+-- Switching to hard delete replaces the partial index with a plain one
+SELECT ttl_create_index('test_soft_partial', 'created_at', 3600, 1000);
+
+SELECT indexname, indexdef LIKE '%WHERE%' AS is_partial
+FROM pg_indexes
+WHERE tablename = 'test_soft_partial' AND indexname LIKE 'idx_ttl%';
+
+SELECT ttl_drop_index('test_soft_partial', 'created_at');
+DROP TABLE test_soft_partial;
+
+-- Test 14: Concurrent index builds defer rule activation
+CREATE TABLE test_concurrent_index (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_concurrent_index (created_at) VALUES (NOW() - INTERVAL '2 hours');
+
+SELECT ttl_create_index('test_concurrent_index', 'created_at', 3600, p_concurrently => true);
+
+SELECT active, index_pending
+FROM ttl_summary()
+WHERE table_name = 'test_concurrent_index';
+
+-- Nothing is deleted while the index is pending
+SELECT ttl_runner();
+
+-- Build the queued index outside a transaction block, as the worker does
+SELECT ddl FROM ttl_pending_index_ddl() AS ddl
+\gexec
+
+SELECT ttl_runner();
+
+SELECT active, index_pending
+FROM ttl_summary()
+WHERE table_name = 'test_concurrent_index';
+
+SELECT ttl_drop_index('test_concurrent_index', 'created_at');
+DROP TABLE test_concurrent_index;
+
+-- Test 15: Priority classes
+CREATE TABLE test_priority (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+SELECT ttl_create_index('test_priority', 'created_at', 3600, p_priority => 'high');
+
+SELECT table_name, priority
+FROM ttl_summary()
+WHERE table_name = 'test_priority';
+
+-- Unknown priority classes are rejected
+SELECT ttl_create_index('test_priority', 'created_at', 3600, p_priority => 'urgent');
+
+SELECT ttl_drop_index('test_priority', 'created_at');
+DROP TABLE test_priority;
+
+-- Test 16: Expiry lag is recorded after each pass
+CREATE TABLE test_expiry_lag (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_expiry_lag (created_at) VALUES
+    (NOW() - INTERVAL '2 hours'),
+    (NOW());
+
+SELECT ttl_create_index('test_expiry_lag', 'created_at', 3600);
+
+SELECT expiry_lag_seconds
+FROM ttl_summary()
+WHERE table_name = 'test_expiry_lag';
+
+SELECT ttl_runner();
+
+-- The backlog was drained, so nothing is past its cutoff
+SELECT expiry_lag_seconds
+FROM ttl_summary()
+WHERE table_name = 'test_expiry_lag';
+
+SELECT ttl_drop_index('test_expiry_lag', 'created_at');
+DROP TABLE test_expiry_lag;
+
+-- Test 17: Maintenance windows
+SELECT w.spec, s.in_window,
+       pg_catalog.to_char(s.next_boundary AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI') AS next_boundary
+FROM (VALUES ('02:00-05:00 UTC', '2026-01-01 03:00+00'::TIMESTAMPTZ),
+             ('22:00-02:00 UTC', '2026-01-01 12:00+00'::TIMESTAMPTZ),
+             ('22:00-02:00 UTC', '2026-01-01 23:30+00'::TIMESTAMPTZ)) AS w(spec, at_time),
+     LATERAL ttl_window_state(w.spec, w.at_time) s;
+
+CREATE TABLE test_window (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+SELECT ttl_create_index('test_window', 'created_at', 3600,
+                        p_maintenance_window => '02:00-05:00 UTC', p_run_only_in_window => true);
+
+SELECT table_name, maintenance_window, run_only_in_window
+FROM ttl_summary()
+WHERE table_name = 'test_window';
+
+-- Malformed windows are rejected
+SELECT ttl_create_index('test_window', 'created_at', 3600, p_maintenance_window => 'nightly');
+
+SELECT ttl_drop_index('test_window', 'created_at');
+DROP TABLE test_window;
+
+-- Test 18: Expression rules
+CREATE TABLE test_expression (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW(),
+    updated_at TIMESTAMPTZ
+);
+
+INSERT INTO test_expression (created_at, updated_at) VALUES
+    (NOW() - INTERVAL '2 hours', NULL),
+    (NOW() - INTERVAL '2 hours', NOW()),
+    (NOW(), NULL);
+
+SELECT ttl_create_index('test_expression', 'COALESCE(updated_at, created_at)', 3600);
+
+SELECT indexdef
+FROM pg_indexes
+WHERE tablename = 'test_expression' AND indexname LIKE 'idx_ttl_%';
+
+-- Only the row whose last update is older than the TTL expires
+SELECT ttl_runner();
+
+SELECT count(*) FROM test_expression;
+
+-- Expressions that would end the parentheses early are rejected
+SELECT ttl_create_index('test_expression', 'created_at) OR (now()', 3600);
+SELECT ttl_create_index('test_expression', 'created_at --', 3600);
+
+-- Expressions must evaluate to a timestamp
+SELECT ttl_create_index('test_expression', 'id::TEXT', 3600);
+
+SELECT ttl_drop_index('test_expression', 'COALESCE(updated_at, created_at)');
+DROP TABLE test_expression;
+
+-- Test 19: Epoch and date TTL columns
+CREATE TABLE test_epoch (
+    id SERIAL PRIMARY KEY,
+    event_ts BIGINT NOT NULL
+);
+
+INSERT INTO test_epoch (event_ts) VALUES
+    ((EXTRACT(EPOCH FROM NOW() - INTERVAL '2 hours') * 1000)::BIGINT),
+    ((EXTRACT(EPOCH FROM NOW()) * 1000)::BIGINT);
+
+-- Integer columns need to state their epoch unit
+SELECT ttl_create_index('test_epoch', 'event_ts', 3600);
+
+SELECT ttl_create_index('test_epoch', 'event_ts', 3600, p_epoch_unit => 'ms');
+
+CREATE TABLE test_date (
+    id SERIAL PRIMARY KEY,
+    event_date DATE NOT NULL
+);
+
+INSERT INTO test_date (event_date) VALUES
+    (CURRENT_DATE - 3),
+    (CURRENT_DATE);
+
+SELECT ttl_create_index('test_date', 'event_date', 86400);
+
+SELECT ttl_runner();
+
+SELECT count(*) FROM test_epoch;
+
+SELECT count(*) FROM test_date;
+
+SELECT ttl_drop_index('test_epoch', 'event_ts');
+
+SELECT ttl_drop_index('test_date', 'event_date');
+DROP TABLE test_epoch;
+DROP TABLE test_date;
+
+-- Test 20: Row-filtered rules
+CREATE TABLE test_row_filter (
+    id SERIAL PRIMARY KEY,
+    tier TEXT NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_row_filter (tier, created_at) VALUES
+    ('free', NOW() - INTERVAL '2 days'),
+    ('paid', NOW() - INTERVAL '2 days'),
+    ('paid', NOW() - INTERVAL '10 days');
+
+-- Free rows expire after a day, paid rows after a week
+SELECT ttl_create_index('test_row_filter', 'created_at', 86400, p_row_filter => 'tier = ''free''');
+SELECT ttl_create_index('test_row_filter', 'created_at', 604800, p_row_filter => 'tier = ''paid''');
+
+-- Each filter gets its own partial index
+SELECT count(*)
+FROM pg_indexes
+WHERE tablename = 'test_row_filter' AND indexname LIKE 'idx_ttl_%';
+
+-- Filters that would end the parentheses early are rejected
+SELECT ttl_create_index('test_row_filter', 'created_at', 60, p_row_filter => 'tier = ''free'') OR (true');
+SELECT ttl_create_index('test_row_filter', 'created_at', 60, p_row_filter => 'tier = ''free'' --');
+SELECT count(*) FROM ttl_summary() WHERE table_name = 'test_row_filter';
+
+SELECT ttl_runner();
+
+SELECT tier, count(*) FROM test_row_filter GROUP BY tier ORDER BY tier;
+
+SELECT ttl_drop_index('test_row_filter', 'created_at', 'tier = ''free''');
+SELECT ttl_drop_index('test_row_filter', 'created_at', 'tier = ''paid''');
+DROP TABLE test_row_filter;
+
+-- Test 21: Per-group retention from a lookup table
+CREATE TABLE test_tenant_retention (
+    tenant_id INTEGER PRIMARY KEY,
+    seconds BIGINT NOT NULL
+);
+
+INSERT INTO test_tenant_retention VALUES (1, 86400), (2, 864000);
+
+CREATE TABLE test_tenant_events (
+    id SERIAL PRIMARY KEY,
+    tenant_id INTEGER NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_tenant_events (tenant_id, created_at) VALUES
+    (1, NOW() - INTERVAL '2 days'),
+    (2, NOW() - INTERVAL '2 days'),
+    (3, NOW() - INTERVAL '2 days');
+
+-- Tenant 3 is not in the map and uses the one hour default
+SELECT ttl_create_index('test_tenant_events', 'created_at', 3600,
+                        p_group_column => 'tenant_id',
+                        p_retention_table => 'test_tenant_retention');
+
+SELECT indexdef
+FROM pg_indexes
+WHERE tablename = 'test_tenant_events' AND indexname LIKE 'idx_ttl_%';
+
+SELECT ttl_runner();
+
+SELECT tenant_id FROM test_tenant_events ORDER BY tenant_id;
+
+SELECT ttl_drop_index('test_tenant_events', 'created_at');
+DROP TABLE test_tenant_events;
+DROP TABLE test_tenant_retention;
+
+-- Test 22: Cascade-aware expiry
+CREATE TABLE test_cascade_parent (
+    id INTEGER PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+CREATE TABLE test_cascade_child (
+    id SERIAL PRIMARY KEY,
+    parent_id INTEGER NOT NULL REFERENCES test_cascade_parent (id) ON DELETE CASCADE
+);
+
+CREATE INDEX test_cascade_child_parent_id ON test_cascade_child (parent_id);
+
+INSERT INTO test_cascade_parent VALUES (1, NOW() - INTERVAL '2 days'), (2, NOW());
+INSERT INTO test_cascade_child (parent_id) VALUES (1), (1), (2);
+
+SELECT ttl_create_index('test_cascade_parent', 'created_at', 86400, p_cascade_children => true);
+
+SELECT ttl_runner();
+
+SELECT parent_id FROM test_cascade_child ORDER BY parent_id;
+
+-- A table nothing cascades from is rejected
+SELECT ttl_create_index('test_cascade_child', 'id', 3600, p_epoch_unit => 's', p_cascade_children => true);
+
+SELECT ttl_drop_index('test_cascade_parent', 'created_at');
+DROP TABLE test_cascade_child;
+DROP TABLE test_cascade_parent;
+
+-- Test 23: Expiry with triggers suppressed
+CREATE TABLE test_audited (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+CREATE TABLE test_audit_log (
+    audited_id INTEGER
+);
+
+CREATE FUNCTION test_audit_delete() RETURNS TRIGGER
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    INSERT INTO test_audit_log VALUES (OLD.id);
+    RETURN OLD;
+END;
+$$;
+
+CREATE TRIGGER test_audited_delete
+    AFTER DELETE ON test_audited
+    FOR EACH ROW EXECUTE FUNCTION test_audit_delete();
+
+INSERT INTO test_audited (created_at) VALUES
+    (NOW() - INTERVAL '2 days'),
+    (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_audited', 'created_at', 86400, p_disable_triggers => true);
+
+SELECT ttl_runner();
+
+-- Expired rows are gone and the audit trigger did not fire
+SELECT count(*) FROM test_audited;
+SELECT count(*) FROM test_audit_log;
+
+SELECT ttl_drop_index('test_audited', 'created_at');
+DROP TABLE test_audited;
+DROP TABLE test_audit_log;
+DROP FUNCTION test_audit_delete();
+
+-- Test 24: Tagging expiry with a replication origin
+CREATE TABLE test_origin (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_origin (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_origin', 'created_at', 86400, p_replication_origin => 'pg_ttl_index_test');
+
+-- The origin is created with the rule
+SELECT roname FROM pg_replication_origin WHERE roname = 'pg_ttl_index_test';
+
+SELECT ttl_runner();
+
+-- and only set while the rule runs
+SELECT pg_replication_origin_session_is_setup();
+
+SELECT ttl_drop_index('test_origin', 'created_at');
+SELECT pg_replication_origin_drop('pg_ttl_index_test');
+DROP TABLE test_origin;
+
+-- Test 25: Per-phase run profile
+CREATE TABLE test_profile (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_profile (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_profile', 'created_at', 86400);
+
+SET pg_ttl_index.profile = on;
+SELECT ttl_runner();
+RESET pg_ttl_index.profile;
+
+SELECT phase FROM ttl_last_run_profile() WHERE phase IN ('setup', 'expire', 'stats_update') ORDER BY phase;
+SELECT bool_and(calls > 0 AND wall_ms >= 0 AND cpu_ms >= 0) AS sane FROM ttl_last_run_profile();
+
+SELECT ttl_drop_index('test_profile', 'created_at');
+DROP TABLE test_profile;
+
+-- Test 26: Plan capture for cleanup batches
+CREATE TABLE test_explain (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_explain (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_explain', 'created_at', 86400);
+
+SET pg_ttl_index.explain_sample_rate = 1;
+SELECT ttl_runner();
+RESET pg_ttl_index.explain_sample_rate;
+
+-- The captured batch was rolled back and the row deleted once
+SELECT count(*) FROM test_explain;
+
+SELECT last_plan -> 0 -> 'Plan' ->> 'Node Type' AS node_type,
+       last_plan -> 0 -> 'Plan' ->> 'Operation' AS operation,
+       last_plan_at IS NOT NULL AS captured
+FROM ttl_index_table
+WHERE table_name = 'test_explain';
+
+SELECT ttl_drop_index('test_explain', 'created_at');
+DROP TABLE test_explain;
+
+-- Test 27: OpenMetrics exposition
+CREATE TABLE test_metrics (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_metrics (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_metrics', 'created_at', 86400);
+SELECT ttl_runner();
+
+SELECT line
+FROM pg_catalog.regexp_split_to_table(ttl_metrics(), E'\n') AS line
+WHERE line LIKE '%table="test_metrics"%'
+  AND (line LIKE 'pg_ttl_index_rows_deleted_total%' OR line LIKE 'pg_ttl_index_batches_total%')
+ORDER BY line;
+
+SELECT right(ttl_metrics(), 6) = E'# EOF\n' AS terminated;
+
+SELECT ttl_drop_index('test_metrics', 'created_at');
+DROP TABLE test_metrics;
+
+-- Test 28: Slow pass log
+CREATE TABLE test_slow_log (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_slow_log (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_slow_log', 'created_at', 86400);
+
+SET pg_ttl_index.log_min_duration = 0;
+SELECT ttl_runner();
+RESET pg_ttl_index.log_min_duration;
+
+SELECT pg_catalog.array_length(ttl_io_usage(), 1) AS fields;
+
+SELECT ttl_slow_log_entry('pass', 'public', 'test_slow_log', 'created_at', '', 1500, 1234.5678,
+                          ARRAY[10, 2, 0, 1000]::BIGINT[], ARRAY[110, 7, 40, 9192]::BIGINT[], 20);
+
+SELECT ttl_drop_index('test_slow_log', 'created_at');
+DROP TABLE test_slow_log;
+
+-- Test 29: Failure backoff and quarantine
+CREATE TABLE test_backoff (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT NOW()
+);
+
+INSERT INTO test_backoff (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_backoff', 'created_at', 86400);
+
+-- Break the rule; it fails twice and is then quarantined
+ALTER TABLE test_backoff RENAME COLUMN created_at TO created;
+
+SET pg_ttl_index.failure_backoff = 0;
+SET pg_ttl_index.max_consecutive_failures = 2;
+
+SELECT ttl_runner();
+SELECT consecutive_failures, quarantined, last_error FROM ttl_summary() WHERE table_name = 'test_backoff';
+SELECT ttl_runner();
+SELECT ttl_runner();
+SELECT consecutive_failures, quarantined_at IS NOT NULL AS quarantined, total_errors
+FROM ttl_index_table
+WHERE table_name = 'test_backoff';
+
+-- Repaired and released, it runs again
+ALTER TABLE test_backoff RENAME COLUMN created TO created_at;
+SELECT ttl_release_rule('test_backoff', 'created_at');
+SELECT ttl_runner();
+SELECT consecutive_failures, quarantined FROM ttl_summary() WHERE table_name = 'test_backoff';
+
+RESET pg_ttl_index.failure_backoff;
+RESET pg_ttl_index.max_consecutive_failures;
+
+SELECT ttl_drop_index('test_backoff', 'created_at');
+DROP TABLE test_backoff;
+
+-- Test 30: Archive-to-file mode end to end
+COPY (SELECT 1) TO PROGRAM 'rm -rf ttl_archive_test && mkdir ttl_archive_test';
+SET pg_ttl_index.archive_directory = 'ttl_archive_test';
+
+CREATE TABLE test_archive_file (
+    id INTEGER PRIMARY KEY,
+    payload TEXT,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_archive_file VALUES
+    (1, E'tab\there', NOW() - INTERVAL '2 days'),
+    (2, E'line\nbreak\r', NOW() - INTERVAL '2 days'),
+    (3, E'back\\slash \\N', NOW() - INTERVAL '2 days'),
+    (4, NULL, NOW() - INTERVAL '2 days'),
+    (5, 'fresh', NOW());
+
+SELECT ttl_create_index('test_archive_file', 'created_at', 86400, p_archive_to_file => true);
+SELECT ttl_runner();
+SELECT cleanup_mode FROM ttl_summary() WHERE table_name = 'test_archive_file';
+
+-- A batch in a new rotation period goes to a new file; with the longest
+-- rotation age the period starts at the epoch, so no waiting is needed
+SET pg_ttl_index.archive_rotation_age = 2147483647;
+INSERT INTO test_archive_file VALUES (6, 'later', NOW() - INTERVAL '2 days');
+SELECT ttl_runner();
+SELECT count(*) AS archive_files FROM pg_catalog.pg_ls_dir('ttl_archive_test') AS f;
+
+-- The files load back with COPY, escaping intact
+CREATE TABLE test_archive_restored (LIKE test_archive_file);
+COPY test_archive_restored FROM PROGRAM 'gzip -dcf ttl_archive_test/*';
+SELECT r.id, r.payload IS NOT DISTINCT FROM o.payload AS same_payload
+FROM test_archive_restored r
+JOIN (VALUES (1, E'tab\there'), (2, E'line\nbreak\r'), (3, E'back\\slash \\N'),
+             (4, NULL), (6, 'later')) AS o (id, payload)
+  ON o.id = r.id
+ORDER BY r.id;
+SELECT id FROM test_archive_file ORDER BY id;
+
+-- Unusable directories fail the pass before anything is deleted
+SET pg_ttl_index.failure_backoff = 0;
+INSERT INTO test_archive_file VALUES (7, 'stuck', NOW() - INTERVAL '2 days');
+SET pg_ttl_index.archive_directory = 'PG_VERSION';
+SELECT ttl_runner();
+SET pg_ttl_index.archive_directory = 'ttl_archive_missing';
+SELECT ttl_runner();
+SELECT id FROM test_archive_file ORDER BY id;
+RESET pg_ttl_index.failure_backoff;
+
+RESET pg_ttl_index.archive_directory;
+RESET pg_ttl_index.archive_rotation_age;
+COPY (SELECT 1) TO PROGRAM 'rm -rf ttl_archive_test';
+
+SELECT ttl_drop_index('test_archive_file', 'created_at');
+DROP TABLE test_archive_file;
+DROP TABLE test_archive_restored;
+
+-- Test 31: Rule time quantum and cycle time budget
+CREATE TABLE test_rr_a (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+CREATE TABLE test_rr_b (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_rr_a (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+INSERT INTO test_rr_b (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+
+SELECT ttl_create_index('test_rr_a', 'created_at', 86400, 2);
+SELECT ttl_create_index('test_rr_b', 'created_at', 86400, 2);
+
+-- A 1 ms quantum leaves each rule one throttled batch per run
+SET pg_ttl_index.rule_time_quantum = 1;
+SELECT ttl_runner();
+
+-- With the budget used up, only the first rule in line runs ...
+SET pg_ttl_index.cycle_time_budget = 1;
+SELECT ttl_runner();
+SELECT table_name, total_rows_deleted FROM ttl_summary() WHERE table_name LIKE 'test_rr_%' ORDER BY table_name;
+
+-- ... and the rule it starved is first in line on the next run
+SELECT ttl_runner();
+SELECT table_name, total_rows_deleted FROM ttl_summary() WHERE table_name LIKE 'test_rr_%' ORDER BY table_name;
+
+RESET pg_ttl_index.cycle_time_budget;
+RESET pg_ttl_index.rule_time_quantum;
+
+SELECT ttl_drop_index('test_rr_a', 'created_at');
+SELECT ttl_drop_index('test_rr_b', 'created_at');
+DROP TABLE test_rr_a;
+DROP TABLE test_rr_b;
+
+-- Test 32: Expiry lag of a pass cut short
+CREATE TABLE test_lag_backlog (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_lag_backlog (created_at)
+SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+
+SELECT ttl_create_index('test_lag_backlog', 'created_at', 86400, 2);
+
+-- One batch of two rows; the oldest remaining row is a day past its cutoff
+SET pg_ttl_index.rule_time_quantum = 1;
+SELECT ttl_runner();
+SELECT expiry_lag_seconds BETWEEN 86400 AND 86460 AS lag_one_day
+FROM ttl_summary()
+WHERE table_name = 'test_lag_backlog';
+RESET pg_ttl_index.rule_time_quantum;
+
+-- Drained, the lag is back to zero
+SELECT ttl_runner();
+SELECT expiry_lag_seconds FROM ttl_summary() WHERE table_name = 'test_lag_backlog';
+
+SELECT ttl_drop_index('test_lag_backlog', 'created_at');
+DROP TABLE test_lag_backlog;
+
+-- Test 33: Purge still runs when marking is cut short
+CREATE TABLE test_soft_backlog (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL,
+    deleted_at TIMESTAMPTZ
+);
+
+SELECT ttl_create_index('test_soft_backlog', 'created_at', 3600, 2, 'deleted_at',
+                        p_soft_delete_grace_seconds => 3600);
+
+INSERT INTO test_soft_backlog (created_at, deleted_at)
+SELECT NOW() - INTERVAL '3 hours', CASE WHEN i <= 4 THEN NOW() - INTERVAL '2 hours' END
+FROM pg_catalog.generate_series(1, 8) AS i;
+
+-- One marking batch and one purge batch fit in the quantum
+SET pg_ttl_index.rule_time_quantum = 1;
+SELECT ttl_runner();
+RESET pg_ttl_index.rule_time_quantum;
+
+SELECT count(*) AS remaining, count(deleted_at) AS marked FROM test_soft_backlog;
+SELECT total_rows_purged FROM ttl_summary() WHERE table_name = 'test_soft_backlog';
+
+SELECT ttl_drop_index('test_soft_backlog', 'created_at');
+DROP TABLE test_soft_backlog;
+
+-- Test 34: Load watermark and catch-up batches
+CREATE TABLE test_load_a (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+CREATE TABLE test_load_b (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_load_a (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+INSERT INTO test_load_b (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+
+SELECT ttl_create_index('test_load_a', 'created_at', 86400, 1);
+
+-- At the watermark the rule is deferred. It is set to the active backends
+-- counted now, so other sessions on the server do not change the outcome.
+SELECT pg_catalog.set_config('pg_ttl_index.load_watermark', pg_catalog.count(*)::TEXT, false) IS NOT NULL AS watermark_set
+FROM pg_catalog.pg_stat_activity
+WHERE state = 'active' AND backend_type = 'client backend';
+SELECT ttl_runner();
+SELECT count(*) AS remaining FROM test_load_a;
+SELECT deferred_since IS NOT NULL AS deferred FROM ttl_index_table WHERE table_name = 'test_load_a';
+
+-- Well below the watermark only the deferred rule gets catch-up batches
+SELECT ttl_create_index('test_load_b', 'created_at', 86400, 1);
+SET pg_ttl_index.load_watermark = 1000000;
+SET pg_ttl_index.catchup_batch_factor = 4;
+SET pg_ttl_index.rule_time_quantum = 1;
+SELECT ttl_runner();
+SELECT table_name, deferred_since IS NOT NULL AS deferred, total_rows_deleted
+FROM ttl_index_table WHERE table_name LIKE 'test_load_%' ORDER BY table_name;
+
+-- A finished pass clears the backlog marker
+RESET pg_ttl_index.rule_time_quantum;
+SELECT ttl_runner();
+SELECT table_name, deferred_since IS NOT NULL AS deferred, total_rows_deleted
+FROM ttl_index_table WHERE table_name LIKE 'test_load_%' ORDER BY table_name;
+
+RESET pg_ttl_index.catchup_batch_factor;
+RESET pg_ttl_index.load_watermark;
+
+SELECT ttl_drop_index('test_load_a', 'created_at');
+SELECT ttl_drop_index('test_load_b', 'created_at');
+DROP TABLE test_load_a;
+DROP TABLE test_load_b;
+
+-- Test 35: High-priority rules run under load
+CREATE TABLE test_load_high (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+CREATE TABLE test_load_normal (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_load_high (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 3);
+INSERT INTO test_load_normal (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 3);
+
+SELECT ttl_create_index('test_load_high', 'created_at', 86400, p_priority => 'high');
+SELECT ttl_create_index('test_load_normal', 'created_at', 86400);
+
+-- Under load, measured as above
+SELECT pg_catalog.set_config('pg_ttl_index.load_watermark', pg_catalog.count(*)::TEXT, false) IS NOT NULL AS watermark_set
+FROM pg_catalog.pg_stat_activity
+WHERE state = 'active' AND backend_type = 'client backend';
+SELECT ttl_runner();
+SELECT (SELECT count(*) FROM test_load_high) AS high_remaining,
+       (SELECT count(*) FROM test_load_normal) AS normal_remaining;
+RESET pg_ttl_index.load_watermark;
+
+SELECT ttl_drop_index('test_load_high', 'created_at');
+SELECT ttl_drop_index('test_load_normal', 'created_at');
+DROP TABLE test_load_high;
+DROP TABLE test_load_normal;
+
+-- Test 36: Maintenance windows lift the cycle budget
+CREATE TABLE test_win_a (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+CREATE TABLE test_win_b (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_win_a (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+INSERT INTO test_win_b (created_at) SELECT NOW() - INTERVAL '2 days' FROM pg_catalog.generate_series(1, 5);
+
+SELECT ttl_create_index('test_win_a', 'created_at', 86400, 2);
+SELECT ttl_create_index('test_win_b', 'created_at', 86400, 2,
+                        p_maintenance_window => pg_catalog.to_char(NOW() AT TIME ZONE 'UTC' - INTERVAL '1 hour', 'HH24:MI')
+                                                || '-'
+                                                || pg_catalog.to_char(NOW() AT TIME ZONE 'UTC' + INTERVAL '1 hour', 'HH24:MI')
+                                                || ' UTC');
+
+-- The budget stops the first rule after one batch; the rule in its window
+-- still runs to completion
+SET pg_ttl_index.cycle_time_budget = 1;
+SELECT ttl_runner();
+SELECT table_name, total_rows_deleted FROM ttl_summary() WHERE table_name LIKE 'test_win_%' ORDER BY table_name;
+RESET pg_ttl_index.cycle_time_budget;
+
+SELECT ttl_drop_index('test_win_a', 'created_at');
+SELECT ttl_drop_index('test_win_b', 'created_at');
+DROP TABLE test_win_a;
+DROP TABLE test_win_b;
+
+-- Test 37: The caller's lock_timeout is restored after a run
+BEGIN;
+SET lock_timeout = '5s';
+SELECT ttl_runner();
+SHOW lock_timeout;
+COMMIT;
+
+-- Test 38: Null groups and group rotation under a quantum
+CREATE TABLE test_group_retention (
+    tenant_id INTEGER PRIMARY KEY,
+    seconds BIGINT NOT NULL
+);
+
+INSERT INTO test_group_retention VALUES (1, 3600), (2, 3600);
+
+CREATE TABLE test_group_events (
+    id SERIAL PRIMARY KEY,
+    tenant_id INTEGER,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_group_events (tenant_id, created_at)
+SELECT t.tenant_id, NOW() - INTERVAL '2 days'
+FROM (VALUES (1), (2), (NULL)) AS t(tenant_id), pg_catalog.generate_series(1, 3);
+
+-- Two hours old: expired for tenants 1 and 2, not under the one day default
+INSERT INTO test_group_events (tenant_id, created_at) VALUES (NULL, NOW() - INTERVAL '2 hours');
+
+SELECT ttl_create_index('test_group_events', 'created_at', 86400, 2,
+                        p_group_column => 'tenant_id',
+                        p_retention_table => 'test_group_retention');
+
+-- Each run gets one batch, and the next run starts with the next group
+SET pg_ttl_index.rule_time_quantum = 1;
+SELECT ttl_runner();
+SELECT ttl_runner();
+SELECT ttl_runner();
+SELECT tenant_id, count(*) FROM test_group_events GROUP BY tenant_id ORDER BY tenant_id;
+RESET pg_ttl_index.rule_time_quantum;
+
+SELECT ttl_runner();
+SELECT tenant_id, count(*) FROM test_group_events GROUP BY tenant_id ORDER BY tenant_id;
+
+SELECT ttl_drop_index('test_group_events', 'created_at');
+DROP TABLE test_group_events;
+DROP TABLE test_group_retention;
+
+-- Test 39: A failing rule does not leave its replication origin set
+CREATE TABLE test_origin_fail (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+SELECT ttl_create_index('test_origin_fail', 'created_at', 86400, p_replication_origin => 'pg_ttl_index_test');
+ALTER TABLE test_origin_fail RENAME COLUMN created_at TO created;
+
+SELECT ttl_runner();
+SELECT pg_replication_origin_session_is_setup();
+
+SELECT ttl_drop_index('test_origin_fail', 'created_at');
+SELECT pg_replication_origin_drop('pg_ttl_index_test');
+DROP TABLE test_origin_fail;
+
+-- Test 40: A missing replication origin backs off like any failure
+CREATE TABLE test_origin_missing (
+    id SERIAL PRIMARY KEY,
+    created_at TIMESTAMPTZ NOT NULL
+);
+
+INSERT INTO test_origin_missing (created_at) VALUES (NOW() - INTERVAL '2 days');
+
+SELECT ttl_create_index('test_origin_missing', 'created_at', 86400, p_replication_origin => 'pg_ttl_index_test');
+SELECT pg_replication_origin_drop('pg_ttl_index_test');
+
+-- The first run warns, the second skips the rule during its backoff
+SELECT ttl_runner();
+SELECT ttl_runner();
+SELECT consecutive_failures, next_attempt_at > NOW() AS backing_off, last_error
+FROM ttl_index_table
+WHERE table_name = 'test_origin_missing';
+SELECT count(*) AS remaining FROM test_origin_missing;
+
+SELECT ttl_drop_index('test_origin_missing', 'created_at');
+DROP TABLE test_origin_missing;
+
 -- Test complete
 SELECT 'All tests passed!' as result;